@@ -0,0 +1,76 @@
+
+// push/shift/unshift throughput of the array runtime against the old copy-on-every-call behaviour
+// gcc -O2 -Ibuiltins bench/array.c builtins/core/array.c builtins/core/gc.c -lgc -o array_bench && ./array_bench [n]
+
+#include <time.h>
+#include <string.h>
+#include "../builtins/types.h"
+#include "../builtins/core/array.h"
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void naive_push(array* this, any* item) {
+    any** items = malloc(sizeof(any*) * (this->length + 1));
+    memcpy(items, this->items, sizeof(any*) * this->length);
+    items[this->length++] = item;
+    this->items = items;
+}
+
+static any* naive_shift(array* this) {
+    any* out = this->items[0];
+    any** items = malloc(sizeof(any*) * (this->length - 1));
+    memcpy(items, this->items + 1, sizeof(any*) * (this->length - 1));
+    this->length--;
+    this->items = items;
+    return out;
+}
+
+int main(int argc, char** argv) {
+    GC_INIT();
+    uint32_t n = argc > 1 ? atoi(argv[1]) : 50000;
+    any value = {.number = 1};
+    double start;
+
+    array* naive = create_array(0);
+    start = now();
+    for (uint32_t i = 0; i < n; i++) {
+        naive_push(naive, &value);
+    }
+    while (naive->length > 0) {
+        naive_shift(naive);
+    }
+    printf("naive  push+shift %u: %.3fs\n", n, now() - start);
+
+    array* arr = create_array(0);
+    start = now();
+    for (uint32_t i = 0; i < n; i++) {
+        array_push(arr, &value);
+    }
+    while (arr->length > 0) {
+        array_shift(arr);
+    }
+    printf("array  push+shift %u: %.3fs\n", n, now() - start);
+
+    start = now();
+    for (uint32_t i = 0; i < n; i++) {
+        array_unshift(arr, &value);
+    }
+    printf("array  unshift    %u: %.3fs\n", n, now() - start);
+
+    // steady-state queue, the request batching pattern
+    arr = create_array(0);
+    start = now();
+    for (uint32_t i = 0; i < n * 20; i++) {
+        array_push(arr, &value);
+        if (i % 3 != 0) {
+            array_shift(arr);
+        }
+    }
+    printf("array  queue      %u: %.3fs (capacity %u)\n", n * 20, now() - start, arr->capacity);
+    return 0;
+}
@@ -0,0 +1,68 @@
+
+// full-collection mark time with string payloads allocated scanned (GC_malloc) against pointer-free (GC_malloc_atomic)
+// gcc -O2 -Ibuiltins bench/gc_strings.c builtins/core/string.c builtins/core/array.c builtins/core/gc.c -lgc -o gc_bench && ./gc_bench [strings]
+
+#include <time.h>
+#include <string.h>
+#include "../builtins/types.h"
+#include "../builtins/core/array.h"
+#include "../builtins/core/string.h"
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the old alloc_string, which had the collector scan every byte of the string for pointers
+static char* alloc_scanned_string(uint32_t length) {
+    full_string* out = malloc(sizeof(full_string) + length + 1);
+    out->length = length;
+    out->hash = 0;
+    out->flags = 0;
+    out->data[length] = '\0';
+    return out->data;
+}
+
+// text plus the occasional pointer-sized run of bytes, the way string-built JSON, binary data and buffers look
+static void fill(char* data, uint32_t length, void* near) {
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = 'a' + rand() % 26;
+    }
+    if (length >= sizeof(void*) * 2 && rand() % 4 == 0) {
+        memcpy(data + (length / 2 & ~(sizeof(void*) - 1)), &near, sizeof(void*));
+    }
+}
+
+static void run(const char* name, char* (*alloc)(uint32_t), uint32_t count) {
+    srand(1);
+    string_array* strings = create_string_array(0);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t length = 32 + rand() % 1024;
+        char* value = alloc(length);
+        fill(value, length, i > 0 ? strings->items[rand() % i] : NULL);
+        string_array_push(strings, value);
+        // garbage the payloads may point at and falsely keep alive
+        if (i % 4 == 0) {
+            alloc(256);
+        }
+    }
+    GC_gcollect();
+    double start = now();
+    for (int i = 0; i < 10; i++) {
+        GC_gcollect();
+    }
+    double time = (now() - start) / 10;
+    printf("%-8s %.2fms per full collection, heap %zu MB\n", name, time * 1000, GC_get_heap_size() >> 20);
+    strings->length = 0;
+    GC_gcollect();
+}
+
+int main(int argc, char** argv) {
+    GC_INIT();
+    uint32_t count = argc > 1 ? atoi(argv[1]) : 200000;
+    run("scanned", alloc_scanned_string, count);
+    run("atomic", alloc_string, count);
+    return 0;
+}
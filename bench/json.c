@@ -0,0 +1,112 @@
+// JSON.parse building a dynamic value against a decoder like the one the generator emits for JSON.parse(text) as Point[], and JSON.stringify of the result
+// gcc -O2 -mavx2 -Ibuiltins bench/json.c builtins/core/json.c builtins/core/string.c builtins/core/atom.c builtins/core/object.c builtins/core/array.c builtins/core/gc.c -lgc -lm -o json_bench && ./json_bench [n]
+
+#include <time.h>
+#include "../builtins/types.h"
+#include "../builtins/core/gc.h"
+#include "../builtins/core/array.h"
+#include "../builtins/core/object.h"
+#include "../builtins/core/string.h"
+#include "../builtins/core/json.h"
+
+
+typedef struct point {
+    double js_x;
+    double js_y;
+    char* js_label;
+} point;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static point* read_point(json_parser* p) {
+    point* out = malloc(sizeof(point));
+    if (json_object_begin(p)) {
+        do {
+            json_token key = json_parse_key(p);
+            if (json_token_equals(key, "x", 1)) {
+                out->js_x = json_parse_number(p);
+            } else if (json_token_equals(key, "y", 1)) {
+                out->js_y = json_parse_number(p);
+            } else if (json_token_equals(key, "label", 5)) {
+                out->js_label = json_parse_string(p);
+            } else {
+                json_skip_value(p);
+            }
+        } while (json_object_next(p));
+    }
+    return out;
+}
+
+static array* read_points(json_parser* p) {
+    array* out = create_array(0);
+    if (json_array_begin(p)) {
+        do {
+            any* item = malloc(sizeof(any));
+            item->object = (object*)read_point(p);
+            array_push(out, item);
+        } while (json_array_next(p));
+    }
+    return out;
+}
+
+static void write_points(json_writer* w, array* value) {
+    json_write_literal(w, "[");
+    for (uint32_t i = 0; i < value->length; i++) {
+        point* item = (point*)value->items[i]->object;
+        json_write_literal(w, i == 0 ? "{\"x\":" : ",{\"x\":");
+        json_write_number(w, item->js_x);
+        json_write_literal(w, ",\"y\":");
+        json_write_number(w, item->js_y);
+        json_write_literal(w, ",\"label\":");
+        json_write_string(w, item->js_label);
+        json_write_literal(w, "}");
+    }
+    json_write_literal(w, "]");
+}
+
+int main(int argc, char** argv) {
+    gc_init();
+    init_object();
+    uint32_t n = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = 10;
+    json_writer w;
+    json_writer_init(&w);
+    json_write_literal(&w, "[");
+    for (uint32_t i = 0; i < n; i++) {
+        char item[96];
+        json_write_raw(&w, item, snprintf(item, sizeof(item), "%s{\"x\": %u.25, \"y\": -%u, \"label\": \"point \\\"%u\\\"\"}", i == 0 ? "" : ",\n", i, i * 7, i));
+    }
+    json_write_literal(&w, "]");
+    char* text = json_writer_finish(&w);
+    double mb = string_length(text) / 1e6 * rounds;
+    double start;
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        json_parse(text);
+    }
+    printf("JSON.parse:           %.0f MB/s\n", mb / (now() - start));
+
+    array* points = NULL;
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        json_parser p;
+        json_parser_init(&p, text);
+        points = read_points(&p);
+        json_parser_end(&p);
+    }
+    printf("JSON.parse as Point[]: %.0f MB/s\n", mb / (now() - start));
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        json_writer_init(&w);
+        write_points(&w, points);
+        json_writer_finish(&w);
+    }
+    printf("JSON.stringify:       %.0f MB/s\n", mb / (now() - start));
+    return 0;
+}
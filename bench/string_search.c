@@ -0,0 +1,62 @@
+
+// find_bytes against glibc memmem on a large text body, plus replaceAll and split throughput
+// gcc -O2 -mavx2 -Ibuiltins bench/string_search.c builtins/core/string.c builtins/core/array.c builtins/core/gc.c -lgc -o string_bench && ./string_bench [megabytes]
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <string.h>
+#include "../builtins/types.h"
+#include "../builtins/core/array.h"
+#include "../builtins/core/string.h"
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do"};
+
+int main(int argc, char** argv) {
+    GC_INIT();
+    uint32_t megabytes = argc > 1 ? atoi(argv[1]) : 16;
+    uint32_t length = megabytes << 20;
+    char* text = alloc_string(length);
+    uint32_t pos = 0;
+    srand(1);
+    while (pos < length) {
+        char* word = words[rand() % 10];
+        for (uint32_t i = 0; word[i] != '\0' && pos < length; i++) {
+            text[pos++] = word[i];
+        }
+        if (pos < length) {
+            text[pos++] = rand() % 16 == 0 ? '\n' : ' ';
+        }
+    }
+    char* needles[] = {"\n", "amet sit", "consectetur adipiscing elit sed", "lorem ipsum dolor sit amet consectetur adipiscing elit sed do not found"};
+    for (int n = 0; n < 4; n++) {
+        char* needle = needles[n];
+        uint32_t needle_length = strlen(needle);
+        uint32_t ours = 0;
+        uint32_t theirs = 0;
+        double start = now();
+        for (int64_t i = 0, found; (found = find_bytes(text + i, length - i, needle, needle_length)) >= 0; i += found + needle_length) {
+            ours++;
+        }
+        double ours_time = now() - start;
+        start = now();
+        for (char* p = text; (p = memmem(p, length - (p - text), needle, needle_length)) != NULL; p += needle_length) {
+            theirs++;
+        }
+        double theirs_time = now() - start;
+        printf("needle %2u bytes: find_bytes %.3fs, memmem %.3fs (%u/%u matches)\n", needle_length, ours_time, theirs_time, ours, theirs);
+    }
+    double start = now();
+    char* replaced = string_replaceAll(text, string_from_c("amet"), string_from_c("AMET!"));
+    printf("replaceAll: %.3fs (%u -> %u bytes)\n", now() - start, length, string_length(replaced));
+    start = now();
+    string_array* lines = string_split(text, string_from_c("\n"));
+    printf("split:      %.3fs (%u lines)\n", now() - start, lines->length);
+    return 0;
+}
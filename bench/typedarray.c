@@ -0,0 +1,88 @@
+// the vectorized typed array kernels against the element at a time loops the generator used to emit for them
+// gcc -O2 -mavx2 -Ibuiltins bench/typedarray.c builtins/core/typedarray.c builtins/core/array.c builtins/core/gc.c -lgc -lm -o typedarray_bench && ./typedarray_bench [n]
+
+#include <time.h>
+#include <string.h>
+#include "../builtins/types.h"
+#include "../builtins/core/gc.h"
+#include "../builtins/core/typedarray.h"
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// volatile so the loops can't be vectorized away from what they stand for
+static volatile double sink;
+
+int main(int argc, char** argv) {
+    gc_init();
+    uint32_t n = argc > 1 ? atoi(argv[1]) : 1 << 22;
+    int rounds = 50;
+    int16array* shorts = create_int16array(n);
+    float64array* doubles = create_float64array(n);
+    double start;
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i++) {
+            int16array_set_index(shorts, i, r);
+        }
+    }
+    printf("Int16Array fill:      loop %.3fs, ", now() - start);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        int16array_fill(shorts, r, 0, NaN);
+    }
+    printf("kernel %.3fs\n", now() - start);
+
+    int16array_set_index(shorts, n - 1, -1);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (int16array_get_index(shorts, i) == -1) {
+                sink = i;
+                break;
+            }
+        }
+    }
+    printf("Int16Array indexOf:   loop %.3fs, ", now() - start);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        sink = int16array_indexOf(shorts, -1, 0);
+    }
+    printf("kernel %.3fs\n", now() - start);
+
+    float64array_set_index(doubles, n - 1, 0.5);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (float64array_get_index(doubles, i) == 0.5) {
+                sink = i;
+                break;
+            }
+        }
+    }
+    printf("Float64Array indexOf: loop %.3fs, ", now() - start);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        sink = float64array_indexOf(doubles, 0.5, 0);
+    }
+    printf("kernel %.3fs\n", now() - start);
+
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i + 1 < n; i++) {
+            float64array_set_index(doubles, i, float64array_get_index(doubles, i + 1));
+        }
+    }
+    printf("copyWithin:           loop %.3fs, ", now() - start);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+        float64array_copyWithin(doubles, 0, 1, NaN);
+    }
+    printf("kernel %.3fs\n", now() - start);
+    return 0;
+}
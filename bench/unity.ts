@@ -0,0 +1,30 @@
+
+// builds the sample app in bench/unity once per build mode, then times the builds and the binaries
+// npm run build && node --experimental-strip-types bench/unity.ts [runs]
+
+import {join} from 'node:path';
+import * as fs from 'node:fs';
+import {execFileSync} from 'node:child_process';
+import {Compiler} from '../lib/compiler.js';
+import {validate} from '../lib/config.js';
+
+
+const dir = join(import.meta.dirname, 'unity');
+const runs = Number(process.argv[2] ?? 5);
+
+for (let buildMode of ['separate', 'unity'] as const) {
+    let outDir = join(dir, 'out-' + buildMode);
+    fs.mkdirSync(outDir, {recursive: true});
+    let config = validate({files: [join(dir, 'main.ts')], rootDir: dir, outDir, cache: false, buildMode});
+    let start = performance.now();
+    await new Compiler(config).run();
+    let buildTime = performance.now() - start;
+    let times: number[] = [];
+    for (let i = 0; i < runs; i++) {
+        start = performance.now();
+        execFileSync(join(outDir, 'main'));
+        times.push(performance.now() - start);
+    }
+    times.sort((a, b) => a - b);
+    console.log(`${buildMode.padEnd(8)} build ${buildTime.toFixed(0)}ms, run ${times[Math.floor(runs / 2)].toFixed(0)}ms (median of ${runs})`);
+}
@@ -0,0 +1,7 @@
+import {simulate} from './particles';
+
+let total = 0;
+for (let i = 0; i < 200; i++) {
+    total += simulate(i, -i, 0.5, 0.25, 1000000);
+}
+console.log(total);
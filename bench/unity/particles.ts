@@ -0,0 +1,18 @@
+import {dot, clamp} from './vec';
+
+// small cross-module calls in a hot loop, which only a unity build can inline
+export function simulate(x: number, y: number, vx: number, vy: number, steps: number): number {
+    let energy = 0;
+    for (let i = 0; i < steps; i++) {
+        x = clamp(x + vx, -100, 100);
+        y = clamp(y + vy, -100, 100);
+        if (x === 100 || x === -100) {
+            vx = -vx;
+        }
+        if (y === 100 || y === -100) {
+            vy = -vy;
+        }
+        energy += dot(vx, vy, vx, vy) + dot(x, y, vx, vy) * 0.001;
+    }
+    return energy;
+}
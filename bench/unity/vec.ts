@@ -0,0 +1,12 @@
+export function dot(ax: number, ay: number, bx: number, by: number): number {
+    return ax * bx + ay * by;
+}
+
+export function clamp(x: number, min: number, max: number): number {
+    if (x < min) {
+        return min;
+    } else if (x > max) {
+        return max;
+    }
+    return x;
+}
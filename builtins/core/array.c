@@ -0,0 +1,147 @@
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include "../types.h"
+#include "gc.h"
+#include "array.h"
+
+
+uint32_t array_grow_capacity(uint32_t current, uint32_t needed) {
+    uint32_t out = current < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY : current;
+    while (out < needed) {
+        out += out >> 1;
+    }
+    return out;
+}
+
+// va_type is what type promotes to when passed through ..., empty is what pop and shift return on an empty array
+// alloc is malloc_atomic for item types that can't hold a pointer, so only the first length items are ever initialized
+#define ARRAY_FUNCS(name, type, va_type, empty, alloc) \
+    /* moves the items into a new buffer with the given free slots on either side */ \
+    static void name##_resize(name* this, uint32_t head, uint32_t capacity) { \
+        type* data = alloc(sizeof(type) * (head + capacity)); \
+        memcpy(data + head, this->items, sizeof(type) * this->length); \
+        this->items = data + head; \
+        this->head = head; \
+        this->capacity = capacity; \
+    } \
+    \
+    name* create_##name(uint32_t length) { \
+        name* out = gc_malloc_typed(&array_gc_type); \
+        out->length = length; \
+        out->head = 0; \
+        out->capacity = length < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY : length; \
+        out->items = alloc(sizeof(type) * out->capacity); \
+        memset(out->items, 0, sizeof(type) * length); \
+        return out; \
+    } \
+    \
+    name* create_##name##_with_items(uint32_t length, ...) { \
+        va_list args; \
+        va_start(args, length); \
+        name* out = create_##name(length); \
+        for (uint32_t i = 0; i < length; i++) { \
+            out->items[i] = (type)va_arg(args, va_type); \
+        } \
+        va_end(args); \
+        return out; \
+    } \
+    \
+    void name##_reserve(name* this, uint32_t capacity) { \
+        if (capacity <= this->capacity) { \
+            return; \
+        } \
+        /* a queue that is shifted as fast as it is pushed can reuse the space in front of it instead of growing */ \
+        if (this->head >= this->length && this->head + this->capacity >= capacity + (capacity >> 1)) { \
+            name##_resize(this, 0, this->head + this->capacity); \
+            return; \
+        } \
+        name##_resize(this, this->head, array_grow_capacity(this->capacity, capacity)); \
+    } \
+    \
+    void name##_reserve_head(name* this, uint32_t count) { \
+        if (count <= this->head) { \
+            return; \
+        } \
+        /* size the gap by the array so repeated unshifts stay amortized O(1) */ \
+        name##_resize(this, array_grow_capacity(this->length, count), this->capacity); \
+    } \
+    \
+    type name##_pop(name* this) { \
+        if (this->length == 0) { \
+            return empty; \
+        } \
+        return this->items[--this->length]; \
+    } \
+    \
+    type name##_shift(name* this) { \
+        if (this->length == 0) { \
+            return empty; \
+        } \
+        type out = this->items[0]; \
+        this->items[0] = (type){0}; \
+        this->items++; \
+        this->head++; \
+        this->capacity--; \
+        this->length--; \
+        if (this->length == 0) { \
+            this->items -= this->head; \
+            this->capacity += this->head; \
+            this->head = 0; \
+        } \
+        return out; \
+    } \
+    \
+    void name##_set_length(name* this, uint32_t length) { \
+        if (length > this->capacity) { \
+            name##_reserve(this, length); \
+        } \
+        /* new items are zeroed, truncated ones are cleared so the collector can reclaim them */ \
+        if (length > this->length) { \
+            memset(this->items + this->length, 0, sizeof(type) * (length - this->length)); \
+        } else { \
+            memset(this->items + length, 0, sizeof(type) * (this->length - length)); \
+        } \
+        this->length = length; \
+    }
+
+ARRAY_FUNCS(array, any*, any*, NULL, malloc);
+ARRAY_FUNCS(number_array, double, double, NaN, malloc_atomic);
+ARRAY_FUNCS(string_array, char*, char*, NULL, malloc);
+ARRAY_FUNCS(boolean_array, bool, int, false, malloc_atomic);
+
+
+#define CAST_TO_ANY_ARRAY(name, member) \
+    array* cast_##name##_to_any_array(name* this) { \
+        array* out = create_array(this->length); \
+        any* cells = malloc(sizeof(any) * this->length); \
+        for (uint32_t i = 0; i < this->length; i++) { \
+            cells[i].member = this->items[i]; \
+            out->items[i] = &cells[i]; \
+        } \
+        return out; \
+    }
+
+CAST_TO_ANY_ARRAY(number_array, number);
+CAST_TO_ANY_ARRAY(string_array, string);
+CAST_TO_ANY_ARRAY(boolean_array, boolean);
+
+#define CAST_FROM_ANY_ARRAY(name, member) \
+    void copy_any_array_to_##name(name* this, array* from) { \
+        name##_set_length(this, from->length); \
+        for (uint32_t i = 0; i < from->length; i++) { \
+            this->items[i] = from->items[i] == NULL ? 0 : from->items[i]->member; \
+        } \
+    } \
+    \
+    name* cast_any_array_to_##name(array* this) { \
+        name* out = create_##name(this->length); \
+        copy_any_array_to_##name(out, this); \
+        return out; \
+    }
+
+CAST_FROM_ANY_ARRAY(number_array, number);
+CAST_FROM_ANY_ARRAY(string_array, string);
+CAST_FROM_ANY_ARRAY(boolean_array, boolean);
@@ -0,0 +1,82 @@
+
+#ifndef NEUTRINO_CORE_ARRAY_H
+#define NEUTRINO_CORE_ARRAY_H
+
+#include <stdarg.h>
+#include "../types.h"
+
+
+#define ARRAY_MIN_CAPACITY 8
+
+uint32_t array_grow_capacity(uint32_t current, uint32_t needed);
+
+// declares the storage functions of one element kind, pop, shift and out of range gets return empty
+#define DECLARE_ARRAY_FUNCS(name, type, empty) \
+    name* create_##name(uint32_t length); \
+    name* create_##name##_with_items(uint32_t length, ...); \
+    /* makes room for at least capacity items after items, growing geometrically */ \
+    void name##_reserve(name* this, uint32_t capacity); \
+    /* makes room for at least count free slots before items */ \
+    void name##_reserve_head(name* this, uint32_t count); \
+    type name##_pop(name* this); \
+    type name##_shift(name* this); \
+    void name##_set_length(name* this, uint32_t length); \
+    static inline uint32_t name##_push(name* this, type item) { \
+        if (this->length == this->capacity) { \
+            name##_reserve(this, this->length + 1); \
+        } \
+        this->items[this->length++] = item; \
+        return this->length; \
+    } \
+    static inline uint32_t name##_unshift(name* this, type item) { \
+        if (this->head == 0) { \
+            name##_reserve_head(this, 1); \
+        } \
+        this->items--; \
+        this->head--; \
+        this->capacity++; \
+        this->items[0] = item; \
+        return ++this->length; \
+    } \
+    /* get_at and set_at take an index the generator has proven to be an integer, see Generator.integerIndex */ \
+    static inline type name##_get_at(name* this, uint32_t i) { \
+        return i < this->length ? this->items[i] : empty; \
+    } \
+    static inline type name##_set_at(name* this, uint32_t i, type item) { \
+        if (i >= this->length) { \
+            name##_set_length(this, i + 1); \
+        } \
+        return this->items[i] = item; \
+    } \
+    /* anything but an array index (an integer from 0 to 2^32 - 2) names a property, which these arrays never have */ \
+    static inline bool name##_is_index(double index) { \
+        return index >= 0 && index < 4294967295.0 && (uint32_t)index == index; \
+    } \
+    static inline type name##_get(name* this, double index) { \
+        return name##_is_index(index) ? name##_get_at(this, (uint32_t)index) : empty; \
+    } \
+    static inline type name##_set(name* this, double index, type item) { \
+        return name##_is_index(index) ? name##_set_at(this, (uint32_t)index, item) : item; \
+    }
+
+DECLARE_ARRAY_FUNCS(array, any*, NULL);
+DECLARE_ARRAY_FUNCS(number_array, double, NaN);
+DECLARE_ARRAY_FUNCS(string_array, char*, NULL);
+DECLARE_ARRAY_FUNCS(boolean_array, bool, false);
+
+// boxes every element, the only way a packed array becomes an any[]
+array* cast_number_array_to_any_array(number_array* this);
+array* cast_string_array_to_any_array(string_array* this);
+array* cast_boolean_array_to_any_array(boolean_array* this);
+
+// copies an any[] read back out of a dynamic object into a packed array
+number_array* cast_any_array_to_number_array(array* this);
+string_array* cast_any_array_to_string_array(array* this);
+boolean_array* cast_any_array_to_boolean_array(array* this);
+
+// writes the elements of from back into a packed array after an any[] method changed its boxed copy
+void copy_any_array_to_number_array(number_array* this, array* from);
+void copy_any_array_to_string_array(string_array* this, array* from);
+void copy_any_array_to_boolean_array(boolean_array* this, array* from);
+
+#endif
@@ -0,0 +1,103 @@
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include "../types.h"
+#include "string.h"
+#include "atom.h"
+
+
+char** atom_names = NULL;
+uint32_t atom_count = 0;
+uint32_t atom_names_capacity = 0;
+
+// open addressing, stores atoms (0 means empty), always a power of 2 in size
+atom* atom_table = NULL;
+uint32_t atom_table_capacity = 0;
+uint32_t atom_table_length = 0;
+
+
+static void atom_table_insert(atom value) {
+    uint32_t mask = atom_table_capacity - 1;
+    uint32_t i = string_hash(atom_names[value]) & mask;
+    while (atom_table[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    atom_table[i] = value;
+    atom_table_length++;
+}
+
+static void atom_table_grow(void) {
+    atom* old = atom_table;
+    uint32_t old_capacity = atom_table_capacity;
+    atom_table_capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+    atom_table = malloc_atomic(sizeof(atom) * atom_table_capacity);
+    memset(atom_table, 0, sizeof(atom) * atom_table_capacity);
+    atom_table_length = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i] != 0) {
+            atom_table_insert(old[i]);
+        }
+    }
+}
+
+atom new_atom(char* name) {
+    atom out = ++atom_count;
+    if (out >= atom_names_capacity) {
+        uint32_t capacity = atom_names_capacity == 0 ? 256 : atom_names_capacity * 2;
+        char** names = malloc(sizeof(char*) * capacity);
+        if (atom_names != NULL) {
+            memcpy(names, atom_names, sizeof(char*) * atom_names_capacity);
+        }
+        atom_names = names;
+        atom_names_capacity = capacity;
+    }
+    atom_names[out] = name;
+    if (name != NULL) {
+        if ((atom_table_length + 1) * 2 > atom_table_capacity) {
+            atom_table_grow();
+        }
+        atom_table_insert(out);
+    }
+    return out;
+}
+
+static atom atom_table_find(char* name, uint32_t length, uint32_t hash) {
+    if (atom_table_capacity == 0) {
+        return 0;
+    }
+    uint32_t mask = atom_table_capacity - 1;
+    for (uint32_t i = hash & mask; atom_table[i] != 0; i = (i + 1) & mask) {
+        char* other = atom_names[atom_table[i]];
+        if (string_hash(other) == hash && string_length(other) == length && memcmp(other, name, length) == 0) {
+            return atom_table[i];
+        }
+    }
+    return 0;
+}
+
+atom intern(char* name) {
+    uint32_t length = strlen(name);
+    uint32_t hash = hash_bytes(name, length);
+    atom out = atom_table_find(name, length, hash == 0 ? 1 : hash);
+    return out != 0 ? out : new_atom(create_string(name, length));
+}
+
+atom intern_string(char* value) {
+    atom out = atom_table_find(value, string_length(value), string_hash(value));
+    return out != 0 ? out : new_atom(value);
+}
+
+char* atom_name(atom value) {
+    return atom_names[value];
+}
+
+bool atom_is_symbol(atom value) {
+    return atom_names[value] == NULL;
+}
+
+void init_atoms(char** names, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        new_atom(string_from_c(names[i]));
+    }
+}
@@ -0,0 +1,25 @@
+
+#ifndef NEUTRINO_CORE_ATOM_H
+#define NEUTRINO_CORE_ATOM_H
+
+#include "../types.h"
+
+
+// atom 0 is never allocated, atoms without a name are symbols
+extern char** atom_names;
+extern uint32_t atom_count;
+
+// names are JS strings, see core/string.h
+atom new_atom(char* name);
+// intern takes a C string, intern_string a JS string and uses its cached length and hash
+atom intern(char* name);
+atom intern_string(char* value);
+char* atom_name(atom value);
+bool atom_is_symbol(atom value);
+
+// registers the atoms the compiler assigned, must run before anything else interns
+void init_atoms(char** names, uint32_t count);
+
+#define create_symbol() new_atom(NULL)
+
+#endif
@@ -0,0 +1,16 @@
+
+#ifndef NEUTRINO_CORE_FUNCTION_H
+#define NEUTRINO_CORE_FUNCTION_H
+
+#include "../types.h"
+
+
+// functions that capture nothing get a static closure from the generator instead
+static inline closure* create_closure(void* func, void* env) {
+    closure* out = malloc(sizeof(closure));
+    out->func = func;
+    out->env = env;
+    return out;
+}
+
+#endif
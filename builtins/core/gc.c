@@ -0,0 +1,53 @@
+
+#include <stddef.h>
+#include <string.h>
+#include <gc_typed.h>
+#include "../types.h"
+#include "gc.h"
+
+
+void gc_init(void) {
+    GC_INIT();
+#ifdef NEUTRINO_GENERATIONAL_GC
+    // uses virtual dirty bits, so the generated code needs no write barriers
+    GC_enable_incremental();
+#endif
+}
+
+static GC_descr gc_descr(gc_type* type) {
+    if (!type->ready) {
+        // GC_BITMAP_SIZE takes a type, the size is only known here
+        GC_word bitmap[(type->size / sizeof(GC_word) + GC_WORDSZ - 1) / GC_WORDSZ];
+        memset(bitmap, 0, sizeof(bitmap));
+        for (uint32_t i = 0; i < type->pointer_count; i++) {
+            GC_set_bit(bitmap, type->pointers[i] / sizeof(GC_word));
+        }
+        type->descr = GC_make_descriptor(bitmap, type->size / sizeof(GC_word));
+        type->ready = true;
+    }
+    return type->descr;
+}
+
+void* gc_malloc_typed(gc_type* type) {
+    void* out = GC_malloc_explicitly_typed(type->size, gc_descr(type));
+    if (out == NULL) {
+        fprintf(stderr, "FatalInternalError: malloc failed");
+    }
+    return out;
+}
+
+void* gc_calloc_typed(size_t count, gc_type* type) {
+    void* out = GC_calloc_explicitly_typed(count, type->size, gc_descr(type));
+    if (out == NULL) {
+        fprintf(stderr, "FatalInternalError: malloc failed");
+    }
+    return out;
+}
+
+
+GC_TYPE(shape_gc_type, shape, offsetof(shape, parent), offsetof(shape, prototype), offsetof(shape, transitions), offsetof(shape, proto_cache_holder));
+GC_TYPE(rope_gc_type, rope, offsetof(rope, flat), offsetof(rope, left), offsetof(rope, right));
+GC_TYPE(map_gc_type, map, offsetof(map, slots), offsetof(map, entries));
+GC_TYPE(map_entry_gc_type, map_entry, GC_UNKNOWN_OFFSET(map_entry, key), GC_UNKNOWN_OFFSET(map_entry, value));
+// every array kind has the same header, only items points anywhere
+GC_TYPE(array_gc_type, array, offsetof(array, items));
@@ -0,0 +1,44 @@
+
+#ifndef NEUTRINO_CORE_GC_H
+#define NEUTRINO_CORE_GC_H
+
+#include <stddef.h>
+#include <gc_typed.h>
+#include "../types.h"
+
+
+// tells the collector which words of a struct can hold pointers, so the rest (doubles, hashes, lengths) are never mistaken for one
+// offsets are in bytes and must be word aligned, the descriptor is built the first time the type is allocated
+typedef struct gc_type {
+    size_t size;
+    uint32_t pointer_count;
+    const uint32_t* pointers;
+    GC_descr descr;
+    bool ready;
+} gc_type;
+
+#define GC_TYPE(name, type, ...) \
+    static const uint32_t name##_pointers[] = {__VA_ARGS__}; \
+    gc_type name = {sizeof(type), sizeof(name##_pointers) / sizeof(uint32_t), name##_pointers, 0, false};
+
+// the word of an unknown field that can hold a pointer
+#ifdef NEUTRINO_NAN_BOXING
+#define GC_UNKNOWN_OFFSET(type, field) offsetof(type, field)
+#else
+#define GC_UNKNOWN_OFFSET(type, field) (offsetof(type, field) + offsetof(unknown, value))
+#endif
+
+// with NEUTRINO_GENERATIONAL_GC the collector runs in generational mode, so most collections only scan pages written since the last one
+void gc_init(void);
+
+void* gc_malloc_typed(gc_type* type);
+// an array of count structs of the type
+void* gc_calloc_typed(size_t count, gc_type* type);
+
+extern gc_type shape_gc_type;
+extern gc_type rope_gc_type;
+extern gc_type map_gc_type;
+extern gc_type map_entry_gc_type;
+extern gc_type array_gc_type;
+
+#endif
@@ -0,0 +1,158 @@
+
+#include "../types.h"
+#include "atom.h"
+#include "array.h"
+#include "string.h"
+#include "ic.h"
+
+
+// own entries stay good forever, shapes never change, the rest go when a prototype has changed shape since they were filled
+static void ic_revalidate(inline_cache* ic) {
+    if (ic->epoch == shape_epoch) {
+        return;
+    }
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ic->count; i++) {
+        if (ic->entries[i].kind == IC_OWN) {
+            ic->entries[count++] = ic->entries[i];
+        }
+    }
+    ic->count = count;
+    ic->epoch = shape_epoch;
+}
+
+any ic_miss(inline_cache* ic, object* this, atom key) {
+    shape* s = this->shape;
+    ic_entry entry = {.shape = s, .holder = NULL, .slot = shape_find(s, key), .kind = IC_OWN};
+    if (entry.slot == SHAPE_NOT_FOUND) {
+        object* holder = s->prototype;
+        while (holder != NULL) {
+            entry.slot = shape_find(holder->shape, key);
+            if (entry.slot != SHAPE_NOT_FOUND) {
+                break;
+            }
+            holder = holder->shape->prototype;
+        }
+        entry.holder = holder;
+        entry.kind = holder == NULL ? IC_ABSENT : IC_PROTO;
+    }
+    ic_revalidate(ic);
+    if (ic->count < IC_WAYS) {
+        ic->entries[ic->count++] = entry;
+    }
+    if (entry.kind == IC_ABSENT) {
+        return (any){.undefined = NULL};
+    }
+    return (entry.holder ? entry.holder : this)->slots[entry.slot];
+}
+
+
+// the array index an atom names, or false if it isn't one (digits without leading zeros, below 2^32 - 1)
+static bool atom_to_index(atom key, uint32_t* out) {
+    char* name = atom_name(key);
+    if (name == NULL || name[0] == '\0' || (name[0] == '0' && name[1] != '\0')) {
+        return false;
+    }
+    uint64_t index = 0;
+    for (char* c = name; *c != '\0'; c++) {
+        if (*c < '0' || *c > '9' || (index = index * 10 + (*c - '0')) >= UINT32_MAX) {
+            return false;
+        }
+    }
+    *out = (uint32_t)index;
+    return true;
+}
+
+// reading from undefined or null, or from a value whose prototype the runtime doesn't have
+_Noreturn static void property_error(const char* type, atom key, bool nullish) {
+    char* name = atom_name(key);
+    if (nullish) {
+        fprintf(stderr, "TypeError: Cannot read properties of %s (reading '%s')\n", type, name == NULL ? "Symbol()" : name);
+    } else {
+        fprintf(stderr, "TypeError: Reading '%s' from %s through any is not supported\n", name == NULL ? "Symbol()" : name, type);
+    }
+    exit(1);
+}
+
+// the same for writes, modules are strict so setting a property of a primitive throws too
+_Noreturn static void set_property_error(const char* type, atom key, bool nullish) {
+    char* name = atom_name(key);
+    if (nullish) {
+        fprintf(stderr, "TypeError: Cannot set properties of %s (setting '%s')\n", type, name == NULL ? "Symbol()" : name);
+    } else {
+        fprintf(stderr, "TypeError: Setting '%s' on %s through any is not supported\n", name == NULL ? "Symbol()" : name, type);
+    }
+    exit(1);
+}
+
+// strings and arrays only have their length and indexes here, anything else would need their prototypes, which the runtime doesn't have
+any get_any_atom(any_value receiver, atom key) {
+    static atom length = 0;
+    if (length == 0) {
+        length = intern("length");
+    }
+    uint32_t index;
+    switch (unknown_type(receiver)) {
+        case OBJECT_TAG:
+            return get_object_atom(unknown_to_object(receiver), key);
+        case STRING_TAG: {
+            char* string = unknown_to_any(receiver).string;
+            if (key == length) {
+                return (any){.number = string_length(string)};
+            } else if (atom_to_index(key, &index)) {
+                return index < string_length(string) ? (any){.string = create_string(string + index, 1)} : (any){.undefined = NULL};
+            }
+            property_error("a string", key, false);
+        }
+        case ARRAY_TAG: {
+            array* items = unknown_to_any(receiver).array;
+            if (key == length) {
+                return (any){.number = items->length};
+            } else if (atom_to_index(key, &index)) {
+                any* item = array_get_at(items, index);
+                return item == NULL ? (any){.undefined = NULL} : *item;
+            }
+            property_error("an array", key, false);
+        }
+        case UNDEFINED_TAG:
+            property_error("undefined", key, true);
+        case NULL_TAG:
+            property_error("null", key, true);
+        default:
+            property_error(unknown_type(receiver) == FUNCTION_TAG ? "a function" : "a primitive", key, false);
+    }
+}
+
+any optional_get_any_atom(any_value receiver, atom key) {
+    uint8_t type = unknown_type(receiver);
+    if (type == UNDEFINED_TAG || type == NULL_TAG) {
+        return (any){.undefined = NULL};
+    }
+    return get_any_atom(receiver, key);
+}
+
+// arrays only take their indexes, their length and other keys would need more than the items
+void set_any_atom(any_value receiver, atom key, any value) {
+    uint32_t index;
+    switch (unknown_type(receiver)) {
+        case OBJECT_TAG:
+            set_object_atom(unknown_to_object(receiver), key, value);
+            return;
+        case ARRAY_TAG:
+            if (atom_to_index(key, &index)) {
+                any* item = malloc(sizeof(any));
+                *item = value;
+                array_set_at(unknown_to_any(receiver).array, index, item);
+                return;
+            }
+            set_property_error("an array", key, false);
+        case UNDEFINED_TAG:
+            set_property_error("undefined", key, true);
+        case NULL_TAG:
+            set_property_error("null", key, true);
+        case STRING_TAG:
+            set_property_error("a string", key, false);
+        default:
+            set_property_error(unknown_type(receiver) == FUNCTION_TAG ? "a function" : "a primitive", key, false);
+    }
+}
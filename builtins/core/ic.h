@@ -0,0 +1,75 @@
+
+#ifndef NEUTRINO_CORE_IC_H
+#define NEUTRINO_CORE_IC_H
+
+#include "../types.h"
+#include "object.h"
+#include "unknown.h"
+
+
+#define IC_WAYS 4
+
+#define IC_OWN 0
+#define IC_PROTO 1
+#define IC_ABSENT 2
+
+typedef struct ic_entry {
+    shape* shape;
+    object* holder;
+    uint32_t slot;
+    uint8_t kind;
+} ic_entry;
+
+// one per property read on an any, the generator gives each site its own (see Generator.inlineCache)
+// entries map a receiver shape to where the key lives, IC_PROTO and IC_ABSENT ones are only good while epoch == shape_epoch
+// once IC_WAYS shapes have been seen the site is megamorphic and stops filling
+typedef struct inline_cache {
+    uint32_t epoch;
+    uint8_t count;
+    ic_entry entries[IC_WAYS];
+} inline_cache;
+
+any ic_miss(inline_cache* ic, object* this, atom key);
+any get_any_atom(any_value receiver, atom key);
+any optional_get_any_atom(any_value receiver, atom key);
+void set_any_atom(any_value receiver, atom key, any value);
+
+static inline any ic_get_object_atom(inline_cache* ic, object* this, atom key) {
+    shape* s = this->shape;
+    for (uint8_t i = 0; i < ic->count; i++) {
+        ic_entry* entry = &ic->entries[i];
+        if (entry->shape != s) {
+            continue;
+        }
+        if (entry->kind == IC_OWN) {
+            return this->slots[entry->slot];
+        }
+        if (ic->epoch != shape_epoch) {
+            break;
+        }
+        return entry->kind == IC_PROTO ? entry->holder->slots[entry->slot] : (any){.undefined = NULL};
+    }
+    return ic_miss(ic, this, key);
+}
+
+static inline any get_any_atom_ic(inline_cache* ic, any_value receiver, atom key) {
+    if (unknown_type(receiver) == OBJECT_TAG) {
+        return ic_get_object_atom(ic, unknown_to_object(receiver), key);
+    }
+    return get_any_atom(receiver, key);
+}
+
+static inline any optional_get_any_atom_ic(inline_cache* ic, any_value receiver, atom key) {
+    if (unknown_type(receiver) == OBJECT_TAG) {
+        return ic_get_object_atom(ic, unknown_to_object(receiver), key);
+    }
+    return optional_get_any_atom(receiver, key);
+}
+
+#define get_any_symbol get_any_atom
+#define optional_get_any_symbol optional_get_any_atom
+#define get_any_symbol_ic get_any_atom_ic
+#define optional_get_any_symbol_ic optional_get_any_atom_ic
+#define set_any_symbol set_any_atom
+
+#endif
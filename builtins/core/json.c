@@ -0,0 +1,846 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+#include <float.h>
+#include "../types.h"
+#include "array.h"
+#include "atom.h"
+#include "object.h"
+#include "string.h"
+#include "json.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__PCLMUL__)
+#include <immintrin.h>
+#endif
+
+
+// deeper than this is most likely an attack on the stack
+#define JSON_MAX_DEPTH 1024
+
+static _Noreturn void error_at(json_parser* this, uint32_t position, const char* message) {
+    fprintf(stderr, "SyntaxError: %s in JSON at position %" PRIu32 "\n", message, position);
+    exit(1);
+}
+
+static inline uint32_t current_position(json_parser* this) {
+    return this->next < this->count ? this->positions[this->next] : this->length;
+}
+
+_Noreturn void json_error(json_parser* this, const char* message) {
+    error_at(this, current_position(this), message);
+}
+
+static _Noreturn void unexpected(json_parser* this, uint32_t position) {
+    if (position >= this->length) {
+        fprintf(stderr, "SyntaxError: Unexpected end of JSON input\n");
+        exit(1);
+    }
+    char message[32];
+    snprintf(message, sizeof(message), "Unexpected token '%c'", this->text[position]);
+    error_at(this, position, message);
+}
+
+static inline void expect(json_parser* this, char c) {
+    if (json_peek(this) != c) {
+        unexpected(this, current_position(this));
+    }
+    this->next++;
+}
+
+
+// stage 1, one bit per byte of a 64 byte block
+typedef struct json_block {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t space;
+} json_block;
+
+#if defined(__AVX2__)
+#define JSON_LANES 2
+typedef __m256i json_vector;
+#define json_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define json_eq(x, c) ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(c))))
+#elif defined(__SSE2__)
+#define JSON_LANES 4
+typedef __m128i json_vector;
+#define json_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define json_eq(x, c) ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c))))
+#endif
+
+static inline void classify(const uint8_t* data, json_block* out) {
+    *out = (json_block){0, 0, 0, 0};
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (int i = 0; i < JSON_LANES; i++) {
+        json_vector x = json_load(data + i * (64 / JSON_LANES));
+        int shift = i * (64 / JSON_LANES);
+        out->quote |= (uint64_t)json_eq(x, '"') << shift;
+        out->backslash |= (uint64_t)json_eq(x, '\\') << shift;
+        out->op |= (uint64_t)(json_eq(x, '{') | json_eq(x, '}') | json_eq(x, '[') | json_eq(x, ']') | json_eq(x, ':') | json_eq(x, ',')) << shift;
+        out->space |= (uint64_t)(json_eq(x, ' ') | json_eq(x, '\t') | json_eq(x, '\n') | json_eq(x, '\r')) << shift;
+    }
+#else
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (data[i]) {
+            case '"':
+                out->quote |= bit;
+                break;
+            case '\\':
+                out->backslash |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                out->op |= bit;
+                break;
+            case ' ': case '\t': case '\n': case '\r':
+                out->space |= bit;
+                break;
+        }
+    }
+#endif
+}
+
+// the characters escaped by an odd run of backslashes, prev_odd carries a run that ends a block into the next one
+static inline uint64_t find_escaped(uint64_t backslash, uint64_t* prev_odd) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    const uint64_t odd_bits = ~even_bits;
+    uint64_t starts = backslash & ~(backslash << 1);
+    // a run continuing from the last block starts at an odd position if the carried run was odd
+    uint64_t even_start_mask = even_bits ^ *prev_odd;
+    uint64_t even_starts = starts & even_start_mask;
+    uint64_t odd_starts = starts & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries;
+    bool overflow = __builtin_add_overflow(backslash, odd_starts, &odd_carries);
+    odd_carries |= *prev_odd;
+    *prev_odd = overflow;
+    uint64_t even_carry_ends = even_carries & ~backslash;
+    uint64_t odd_carry_ends = odd_carries & ~backslash;
+    return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+}
+
+// bit i is the xor of bits 0 to i, so it is set between an opening quote and the one closing it
+static inline uint64_t prefix_xor(uint64_t x) {
+#if defined(__PCLMUL__)
+    return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t)x), _mm_set1_epi8((char)0xFF), 0));
+#else
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+#endif
+}
+
+// fills positions with where every structural character outside of strings, every opening quote and every other value starts
+static void json_index(json_parser* this) {
+    const uint8_t* text = (const uint8_t*)this->text;
+    uint32_t length = this->length;
+    // a value needs at least one byte and one structural after it, so this is always enough
+    uint32_t* positions = malloc_atomic(sizeof(uint32_t) * (length + 1));
+    uint32_t count = 0;
+    uint64_t prev_odd = 0;
+    uint64_t prev_in_string = 0;
+    // the start of the text counts as following a structural
+    uint64_t prev_scalar_pred = 1;
+    uint8_t tail[64];
+    for (uint32_t base = 0; base < length; base += 64) {
+        const uint8_t* block = text + base;
+        if (length - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - base);
+            block = tail;
+        }
+        json_block b;
+        classify(block, &b);
+        uint64_t quote = b.quote & ~find_escaped(b.backslash, &prev_odd);
+        uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+        uint64_t structural = (b.op & ~in_string) | quote;
+        // a value that isn't a string or a container starts after a structural or whitespace
+        uint64_t scalar_pred = structural | b.space;
+        structural |= ((scalar_pred << 1) | prev_scalar_pred) & ~b.space & ~in_string;
+        prev_scalar_pred = scalar_pred >> 63;
+        // only opening quotes are kept, the parser finds the closing ones
+        structural &= ~(quote & ~in_string);
+        while (structural != 0) {
+            positions[count++] = base + __builtin_ctzll(structural);
+            structural &= structural - 1;
+        }
+    }
+    if (prev_in_string != 0) {
+        error_at(this, length, "Unterminated string");
+    }
+    this->positions = positions;
+    this->count = count;
+}
+
+void json_parser_init(json_parser* this, char* text) {
+    this->text = text;
+    this->length = string_length(text);
+    this->next = 0;
+    this->depth = 0;
+    json_index(this);
+}
+
+void json_parser_end(json_parser* this) {
+    if (this->next < this->count) {
+        unexpected(this, this->positions[this->next]);
+    }
+}
+
+
+// stage 2
+// a scalar has to end at whitespace, a structural or the end of the text
+static inline void expect_delimiter(json_parser* this, uint32_t end) {
+    if (end >= this->length) {
+        return;
+    }
+    switch (this->text[end]) {
+        case ' ': case '\t': case '\n': case '\r':
+        case ',': case ':': case ']': case '}':
+            return;
+        default:
+            unexpected(this, end);
+    }
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+double json_parse_number(json_parser* this) {
+    uint32_t start = current_position(this);
+    char* s = this->text + start;
+    char* p = s;
+    bool negative = *p == '-';
+    if (negative) {
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    bool exact = true;
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        for (; is_digit(*p); p++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+            } else {
+                exact = false;
+                exponent++;
+            }
+        }
+    } else {
+        unexpected(this, start);
+    }
+    if (*p == '.') {
+        p++;
+        if (!is_digit(*p)) {
+            unexpected(this, p - this->text);
+        }
+        for (; is_digit(*p); p++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            } else {
+                exact = false;
+            }
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool negative_exponent = *p == '-';
+        if (*p == '-' || *p == '+') {
+            p++;
+        }
+        if (!is_digit(*p)) {
+            unexpected(this, p - this->text);
+        }
+        int32_t e = 0;
+        for (; is_digit(*p); p++) {
+            if (e < 100000) {
+                e = e * 10 + (*p - '0');
+            }
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+    expect_delimiter(this, p - this->text);
+    this->next++;
+    // both are exact doubles, so one multiplication or division rounds correctly
+    if (exact && mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+        return negative ? -value : value;
+    }
+    return strtod(s, NULL);
+}
+
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static int32_t read_hex4(json_parser* this, char* p) {
+    int32_t out = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_digit(p[i]);
+        if (digit < 0) {
+            error_at(this, p - this->text, "Bad Unicode escape");
+        }
+        out = out << 4 | digit;
+    }
+    return out;
+}
+
+// the offset of the first byte that has to be escaped, a quote, a backslash or a control character
+static inline uint32_t find_escape(const uint8_t* data, uint32_t length) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F));
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(control, special));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+        uint32_t mask = _mm_movemask_epi8(_mm_or_si128(control, special));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (data[i] < 0x20 || data[i] == '"' || data[i] == '\\') {
+            return i;
+        }
+    }
+    return length;
+}
+
+// the closing quote is the first one that isn't escaped, stage 1 made sure there is one
+// control characters and escapes are checked on the way, so a skipped string is checked as well
+static json_token read_string(json_parser* this, bool* escaped) {
+    if (json_peek(this) != '"') {
+        unexpected(this, current_position(this));
+    }
+    char* start = this->text + this->positions[this->next++] + 1;
+    char* end = this->text + this->length;
+    char* p = start;
+    *escaped = false;
+    while (true) {
+        p += find_escape((const uint8_t*)p, end - p);
+        if (p == end) {
+            error_at(this, this->length, "Unterminated string");
+        }
+        if (*p == '"') {
+            return (json_token){start, p - start};
+        }
+        if ((uint8_t)*p < 0x20) {
+            error_at(this, p - this->text, "Bad control character in string literal");
+        }
+        *escaped = true;
+        switch (p + 1 < end ? p[1] : '\0') {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                p += 2;
+                break;
+            case 'u':
+                if (end - p < 6) {
+                    error_at(this, p + 2 - this->text, "Bad Unicode escape");
+                }
+                read_hex4(this, p + 2);
+                p += 6;
+                break;
+            default:
+                error_at(this, p + 1 - this->text, "Bad escaped character");
+        }
+    }
+}
+
+static uint32_t write_utf8(char* out, uint32_t code) {
+    if (code < 0x80) {
+        out[0] = code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = 0xC0 | code >> 6;
+        out[1] = 0x80 | (code & 0x3F);
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = 0xE0 | code >> 12;
+        out[1] = 0x80 | (code >> 6 & 0x3F);
+        out[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | code >> 18;
+    out[1] = 0x80 | (code >> 12 & 0x3F);
+    out[2] = 0x80 | (code >> 6 & 0x3F);
+    out[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+// an escape is never shorter than what it stands for, so the result fits in token.length bytes
+static uint32_t unescape(json_parser* this, json_token token, char* out) {
+    char* p = token.data;
+    char* end = token.data + token.length;
+    uint32_t length = 0;
+    while (p < end) {
+        char* backslash = memchr(p, '\\', end - p);
+        if (backslash == NULL) {
+            backslash = end;
+        }
+        memcpy(out + length, p, backslash - p);
+        length += backslash - p;
+        if (backslash == end) {
+            break;
+        }
+        p = backslash + 2;
+        switch (backslash[1]) {
+            case '"': out[length++] = '"'; break;
+            case '\\': out[length++] = '\\'; break;
+            case '/': out[length++] = '/'; break;
+            case 'b': out[length++] = '\b'; break;
+            case 'f': out[length++] = '\f'; break;
+            case 'n': out[length++] = '\n'; break;
+            case 'r': out[length++] = '\r'; break;
+            case 't': out[length++] = '\t'; break;
+            case 'u': {
+                if (end - p < 4) {
+                    error_at(this, p - this->text, "Bad Unicode escape");
+                }
+                uint32_t code = read_hex4(this, p);
+                p += 4;
+                // a lone surrogate is kept as it is
+                if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    uint32_t low = read_hex4(this, p + 2);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                length += write_utf8(out + length, code);
+                break;
+            }
+            default:
+                error_at(this, backslash + 1 - this->text, "Bad escaped character");
+        }
+    }
+    return length;
+}
+
+char* json_parse_string(json_parser* this) {
+    bool escaped;
+    json_token token = read_string(this, &escaped);
+    if (!escaped) {
+        return create_string(token.data, token.length);
+    }
+    char* out = alloc_string(token.length);
+    uint32_t length = unescape(this, token, out);
+    string_header(out)->length = length;
+    out[length] = '\0';
+    return out;
+}
+
+static inline void read_literal(json_parser* this, const char* literal, uint32_t length) {
+    uint32_t start = current_position(this);
+    if (this->length - start < length || memcmp(this->text + start, literal, length) != 0) {
+        unexpected(this, start);
+    }
+    expect_delimiter(this, start + length);
+    this->next++;
+}
+
+bool json_parse_boolean(json_parser* this) {
+    if (json_peek(this) == 't') {
+        read_literal(this, "true", 4);
+        return true;
+    }
+    read_literal(this, "false", 5);
+    return false;
+}
+
+void json_parse_null(json_parser* this) {
+    read_literal(this, "null", 4);
+}
+
+bool json_array_begin(json_parser* this) {
+    expect(this, '[');
+    if (json_peek(this) == ']') {
+        this->next++;
+        return false;
+    }
+    if (++this->depth > JSON_MAX_DEPTH) {
+        json_error(this, "Too deeply nested");
+    }
+    return true;
+}
+
+bool json_array_next(json_parser* this) {
+    switch (json_peek(this)) {
+        case ',':
+            this->next++;
+            return true;
+        case ']':
+            this->next++;
+            this->depth--;
+            return false;
+        default:
+            unexpected(this, current_position(this));
+    }
+}
+
+bool json_object_begin(json_parser* this) {
+    expect(this, '{');
+    if (json_peek(this) == '}') {
+        this->next++;
+        return false;
+    }
+    if (++this->depth > JSON_MAX_DEPTH) {
+        json_error(this, "Too deeply nested");
+    }
+    return true;
+}
+
+bool json_object_next(json_parser* this) {
+    switch (json_peek(this)) {
+        case ',':
+            this->next++;
+            return true;
+        case '}':
+            this->next++;
+            this->depth--;
+            return false;
+        default:
+            unexpected(this, current_position(this));
+    }
+}
+
+json_token json_parse_key(json_parser* this) {
+    bool escaped;
+    json_token token = read_string(this, &escaped);
+    if (escaped) {
+        char* out = malloc_atomic(token.length);
+        token.length = unescape(this, token, out);
+        token.data = out;
+    }
+    expect(this, ':');
+    return token;
+}
+
+bool json_token_equals(json_token token, const char* key, uint32_t length) {
+    return token.length == length && memcmp(token.data, key, length) == 0;
+}
+
+// checked as strictly as json_parse_value, only nothing is built
+void json_skip_value(json_parser* this) {
+    switch (json_peek(this)) {
+        case '{':
+            if (json_object_begin(this)) {
+                do {
+                    // read_string checks the key's escapes, it doesn't have to be unescaped
+                    bool escaped;
+                    read_string(this, &escaped);
+                    expect(this, ':');
+                    json_skip_value(this);
+                } while (json_object_next(this));
+            }
+            break;
+        case '[':
+            if (json_array_begin(this)) {
+                do {
+                    json_skip_value(this);
+                } while (json_array_next(this));
+            }
+            break;
+        case '"': {
+            bool escaped;
+            read_string(this, &escaped);
+            break;
+        }
+        case 't':
+        case 'f':
+            json_parse_boolean(this);
+            break;
+        case 'n':
+            json_parse_null(this);
+            break;
+        default:
+            json_parse_number(this);
+    }
+}
+
+// builds the value the way the rest of the runtime stores it, an untagged any with its tag on the side
+static any parse_any(json_parser* this, uint8_t* tag) {
+    switch (json_peek(this)) {
+        case '{': {
+            object* out = create_object(object_prototype, 0);
+            if (json_object_begin(this)) {
+                do {
+                    json_token key = json_parse_key(this);
+                    uint8_t value_tag;
+                    any value = parse_any(this, &value_tag);
+                    set_object_atom(out, intern_string(create_string(key.data, key.length)), value);
+                } while (json_object_next(this));
+            }
+            *tag = OBJECT_TAG;
+            return (any){.object = out};
+        }
+        case '[': {
+            array* out = create_array(0);
+            if (json_array_begin(this)) {
+                do {
+                    uint8_t item_tag;
+                    any* item = malloc(sizeof(any));
+                    *item = parse_any(this, &item_tag);
+                    array_push(out, item);
+                } while (json_array_next(this));
+            }
+            *tag = ARRAY_TAG;
+            return (any){.array = out};
+        }
+        case '"':
+            *tag = STRING_TAG;
+            return (any){.string = json_parse_string(this)};
+        case 't':
+        case 'f':
+            *tag = BOOLEAN_TAG;
+            return (any){.boolean = json_parse_boolean(this)};
+        case 'n':
+            json_parse_null(this);
+            *tag = NULL_TAG;
+            return (any){.null = NULL};
+        default:
+            *tag = NUMBER_TAG;
+            return (any){.number = json_parse_number(this)};
+    }
+}
+
+any_value json_parse_value(json_parser* this) {
+    uint8_t tag;
+    any value = parse_any(this, &tag);
+    switch (tag) {
+        case OBJECT_TAG:
+            return create_unknown_from_object(value.object);
+        case ARRAY_TAG:
+            return create_unknown_from_array(value.array);
+        case STRING_TAG:
+            return create_unknown_from_string(value.string);
+        case BOOLEAN_TAG:
+            return create_unknown_from_boolean(value.boolean);
+        case NULL_TAG:
+            return create_unknown_from_null(NULL);
+        default:
+            return create_unknown_from_number(value.number);
+    }
+}
+
+any_value json_parse(char* text) {
+    json_parser parser;
+    json_parser_init(&parser, text);
+    any_value out = json_parse_value(&parser);
+    json_parser_end(&parser);
+    return out;
+}
+
+
+void json_writer_init(json_writer* this) {
+    this->capacity = 64;
+    this->length = 0;
+    this->data = malloc_atomic(this->capacity);
+}
+
+void json_writer_reserve(json_writer* this, uint32_t count) {
+    uint32_t needed = this->length + count;
+    if (needed <= this->capacity) {
+        return;
+    }
+    uint32_t capacity = this->capacity;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char* data = malloc_atomic(capacity);
+    memcpy(data, this->data, this->length);
+    this->data = data;
+    this->capacity = capacity;
+}
+
+char* json_writer_finish(json_writer* this) {
+    return create_string(this->data, this->length);
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+void json_write_string(json_writer* this, char* value) {
+    uint32_t length = string_length(value);
+    json_writer_reserve(this, length + 2);
+    this->data[this->length++] = '"';
+    uint32_t start = 0;
+    while (true) {
+        uint32_t i = start + find_escape((const uint8_t*)value + start, length - start);
+        json_write_raw(this, value + start, i - start);
+        if (i == length) {
+            break;
+        }
+        uint8_t c = value[i];
+        switch (c) {
+            case '"': json_write_literal(this, "\\\""); break;
+            case '\\': json_write_literal(this, "\\\\"); break;
+            case '\b': json_write_literal(this, "\\b"); break;
+            case '\f': json_write_literal(this, "\\f"); break;
+            case '\n': json_write_literal(this, "\\n"); break;
+            case '\r': json_write_literal(this, "\\r"); break;
+            case '\t': json_write_literal(this, "\\t"); break;
+            default: {
+                char escape[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF]};
+                json_write_raw(this, escape, sizeof(escape));
+            }
+        }
+        start = i + 1;
+    }
+    json_write_literal(this, "\"");
+}
+
+// the digits of value, backwards from the end of out
+static char* write_digits(char* end, uint64_t value) {
+    do {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+// Number::toString, the shortest digits that read back as value, placed by where the decimal point falls
+void json_write_number(json_writer* this, double value) {
+    if (!isfinite(value)) {
+        json_write_literal(this, "null");
+        return;
+    }
+    char out[32];
+    char* end = out + sizeof(out);
+    // integers that are exact in a double print the same either way
+    if (value == trunc(value) && fabs(value) < 9007199254740992.0) {
+        char* start = write_digits(end, (uint64_t)fabs(value));
+        if (value < 0) {
+            *--start = '-';
+        }
+        json_write_raw(this, start, end - start);
+        return;
+    }
+    // so do numbers with a few decimals that read back from them, a round trip in 15 digits or fewer is always the shortest one
+    for (int k = 1; k <= 6; k++) {
+        double scaled = value * powers_of_ten[k];
+        if (scaled == trunc(scaled) && fabs(scaled) < 1e15 && scaled / powers_of_ten[k] == value) {
+            uint64_t digits = (uint64_t)fabs(scaled);
+            uint64_t unit = (uint64_t)powers_of_ten[k];
+            uint64_t fraction = digits % unit;
+            while (fraction % 10 == 0) {
+                fraction /= 10;
+                unit /= 10;
+            }
+            char* start = write_digits(end, fraction);
+            for (uint64_t width = end - start; (uint64_t)powers_of_ten[width] < unit; width++) {
+                *--start = '0';
+            }
+            *--start = '.';
+            start = write_digits(start, digits / (uint64_t)powers_of_ten[k]);
+            if (value < 0) {
+                *--start = '-';
+            }
+            json_write_raw(this, start, end - start);
+            return;
+        }
+    }
+    // the first precision from 15 digits on that reads back, trailing zeros are trimmed below
+    // subnormals have fewer digits of precision, so for them that only holds from 1 digit on
+    char scientific[32];
+    for (int precision = fabs(value) < DBL_MIN ? 1 : 15; precision <= 17; precision++) {
+        snprintf(scientific, sizeof(scientific), "%.*e", precision - 1, value);
+        if (strtod(scientific, NULL) == value) {
+            break;
+        }
+    }
+    char digits[20];
+    int k = 0;
+    char* p = scientific;
+    uint32_t length = 0;
+    if (*p == '-') {
+        out[length++] = '-';
+        p++;
+    }
+    for (; *p != 'e'; p++) {
+        if (*p != '.') {
+            digits[k++] = *p;
+        }
+    }
+    while (k > 1 && digits[k - 1] == '0') {
+        k--;
+    }
+    int n = atoi(p + 1) + 1;
+    if (k <= n && n <= 21) {
+        memcpy(out + length, digits, k);
+        memset(out + length + k, '0', n - k);
+        length += n;
+    } else if (0 < n && n <= 21) {
+        memcpy(out + length, digits, n);
+        out[length + n] = '.';
+        memcpy(out + length + n + 1, digits + n, k - n);
+        length += k + 1;
+    } else if (-6 < n && n <= 0) {
+        out[length++] = '0';
+        out[length++] = '.';
+        memset(out + length, '0', -n);
+        length += -n;
+        memcpy(out + length, digits, k);
+        length += k;
+    } else {
+        out[length++] = digits[0];
+        if (k > 1) {
+            out[length++] = '.';
+            memcpy(out + length, digits + 1, k - 1);
+            length += k - 1;
+        }
+        length += snprintf(out + length, sizeof(out) - length, "e%c%d", n - 1 < 0 ? '-' : '+', abs(n - 1));
+    }
+    json_write_raw(this, out, length);
+}
+
+void json_write_unknown(json_writer* this, any_value value) {
+    switch (unknown_type(value)) {
+        case NUMBER_TAG:
+            json_write_number(this, unknown_to_number(value));
+            break;
+        case STRING_TAG:
+            json_write_string(this, unknown_to_any(value).string);
+            break;
+        case BOOLEAN_TAG:
+            json_write_boolean(this, unknown_to_any(value).boolean);
+            break;
+        case UNDEFINED_TAG:
+        case NULL_TAG:
+            json_write_literal(this, "null");
+            break;
+        default:
+            fprintf(stderr, "TypeError: JSON.stringify can't write an object of unknown type, give it a type first\n");
+            exit(1);
+    }
+}
@@ -0,0 +1,99 @@
+
+#ifndef NEUTRINO_CORE_JSON_H
+#define NEUTRINO_CORE_JSON_H
+
+#include <stdbool.h>
+#include <string.h>
+#include "../types.h"
+#include "unknown.h"
+
+
+/*
+JSON.parse runs in two passes, like simdjson
+- json_index finds every structural character outside of strings, and where every string and every other value starts, 64 bytes at a time
+- the parser then walks those positions instead of the text
+json_parse builds a dynamic value, the schema decoders the generator emits for JSON.parse(text) as T (see Generator.jsonReader) use the json_* functions below to fill T's struct directly
+*/
+
+typedef struct json_parser {
+    char* text;
+    uint32_t length;
+    uint32_t* positions;
+    uint32_t count;
+    uint32_t next;
+    uint32_t depth;
+} json_parser;
+
+// a key as it is in the text between the quotes, or unescaped if it had escapes
+typedef struct json_token {
+    char* data;
+    uint32_t length;
+} json_token;
+
+// prints a SyntaxError and exits, the runtime has no exceptions to throw it as
+_Noreturn void json_error(json_parser* this, const char* message);
+
+void json_parser_init(json_parser* this, char* text);
+// fails unless everything has been read
+void json_parser_end(json_parser* this);
+
+// the character the next value or structural starts with, or '\0' at the end
+static inline char json_peek(json_parser* this) {
+    return this->next < this->count ? this->text[this->positions[this->next]] : '\0';
+}
+
+double json_parse_number(json_parser* this);
+char* json_parse_string(json_parser* this);
+bool json_parse_boolean(json_parser* this);
+void json_parse_null(json_parser* this);
+any_value json_parse_value(json_parser* this);
+void json_skip_value(json_parser* this);
+
+// begin reads the opening bracket and returns false for an empty array or object, next reads what follows an element and returns false at the end
+bool json_array_begin(json_parser* this);
+bool json_array_next(json_parser* this);
+bool json_object_begin(json_parser* this);
+bool json_object_next(json_parser* this);
+// reads a key and the colon after it
+json_token json_parse_key(json_parser* this);
+bool json_token_equals(json_token token, const char* key, uint32_t length);
+
+any_value json_parse(char* text);
+
+
+// JSON.stringify, the generator emits a writer for each type (see Generator.jsonWriter), only any values are written by walking them
+typedef struct json_writer {
+    char* data;
+    uint32_t length;
+    uint32_t capacity;
+} json_writer;
+
+void json_writer_init(json_writer* this);
+void json_writer_reserve(json_writer* this, uint32_t count);
+char* json_writer_finish(json_writer* this);
+
+static inline void json_write_raw(json_writer* this, const char* data, uint32_t length) {
+    if (this->length + length > this->capacity) {
+        json_writer_reserve(this, length);
+    }
+    memcpy(this->data + this->length, data, length);
+    this->length += length;
+}
+
+#define json_write_literal(this, value) json_write_raw(this, value, sizeof(value) - 1)
+
+static inline void json_write_boolean(json_writer* this, bool value) {
+    if (value) {
+        json_write_literal(this, "true");
+    } else {
+        json_write_literal(this, "false");
+    }
+}
+
+// NaN and the infinities are written as null, everything else the way Number.prototype.toString would
+void json_write_number(json_writer* this, double value);
+void json_write_string(json_writer* this, char* value);
+// objects and arrays can't be walked without their types, so an any can only hold a primitive
+void json_write_unknown(json_writer* this, any_value value);
+
+#endif
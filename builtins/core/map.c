@@ -0,0 +1,229 @@
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include "../types.h"
+#include "unknown.h"
+#include "gc.h"
+#include "string.h"
+#include "map.h"
+
+
+static uint32_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return (uint32_t)value;
+}
+
+uint32_t hash_key(unknown key) {
+    uint8_t type = union_type(key);
+    any value = union_to_any(key);
+    switch (type) {
+        case NUMBER_TAG: {
+            double number = union_to_number(key);
+            uint64_t bits;
+            if (number == 0) {
+                number = 0;
+            } else if (isnan(number)) {
+                number = NAN;
+            }
+            memcpy(&bits, &number, sizeof(double));
+            return mix(bits);
+        }
+        case STRING_TAG:
+            return string_hash(value.string);
+        case BIGINT_TAG:
+            return hash_bytes((char*)value.bigint->data, value.bigint->length * sizeof(uint32_t)) ^ BIGINT_TAG;
+        case BOOLEAN_TAG:
+            return mix(((uint64_t)value.boolean << 8) | type);
+        case SYMBOL_TAG:
+            return mix(((uint64_t)value.symbol << 8) | type);
+        case UNDEFINED_TAG:
+        case NULL_TAG:
+            return mix(type);
+        default:
+            return mix((uint64_t)(uintptr_t)value.object);
+    }
+}
+
+bool same_value_zero(unknown x, unknown y) {
+    uint8_t type = union_type(x);
+    if (type != union_type(y)) {
+        return false;
+    }
+    any a = union_to_any(x);
+    any b = union_to_any(y);
+    switch (type) {
+        case NUMBER_TAG: {
+            double m = union_to_number(x);
+            double n = union_to_number(y);
+            return m == n || (isnan(m) && isnan(n));
+        }
+        case STRING_TAG:
+            return string_equals(a.string, b.string);
+        case BIGINT_TAG:
+            return a.bigint->length == b.bigint->length && memcmp(a.bigint->data, b.bigint->data, a.bigint->length * sizeof(uint32_t)) == 0;
+        case BOOLEAN_TAG:
+            return a.boolean == b.boolean;
+        case SYMBOL_TAG:
+            return a.symbol == b.symbol;
+        case UNDEFINED_TAG:
+        case NULL_TAG:
+            return true;
+        default:
+            return a.object == b.object;
+    }
+}
+
+static void map_alloc(map* this, uint32_t capacity) {
+    // keep the slots at most half full
+    uint32_t slot_count = capacity * 2;
+    this->capacity = capacity;
+    this->mask = slot_count - 1;
+    this->slots = malloc_atomic(sizeof(int32_t) * slot_count);
+    memset(this->slots, 0xff, sizeof(int32_t) * slot_count);
+    this->entries = gc_calloc_typed(capacity, &map_entry_gc_type);
+}
+
+map* create_map(void) {
+    map* out = gc_malloc_typed(&map_gc_type);
+    out->size = 0;
+    out->used = 0;
+    out->next_order = 0;
+    out->epoch = 0;
+    map_alloc(out, MAP_MIN_CAPACITY);
+    return out;
+}
+
+// compacts the deleted entries away, growing when the table is mostly live
+static void map_rebuild(map* this) {
+    map_entry* old = this->entries;
+    uint32_t used = this->used;
+    uint32_t capacity = this->capacity;
+    if (this->size >= capacity / 2) {
+        capacity *= 2;
+    }
+    map_alloc(this, capacity);
+    this->used = 0;
+    for (uint32_t i = 0; i < used; i++) {
+        if (!old[i].deleted) {
+            uint32_t slot = old[i].hash & this->mask;
+            while (this->slots[slot] != MAP_EMPTY_SLOT) {
+                slot = (slot + 1) & this->mask;
+            }
+            this->slots[slot] = this->used;
+            this->entries[this->used++] = old[i];
+        }
+    }
+    this->epoch++;
+}
+
+static map_entry* map_find_hashed(map* this, unknown key, uint32_t hash) {
+    for (uint32_t slot = hash & this->mask; this->slots[slot] != MAP_EMPTY_SLOT; slot = (slot + 1) & this->mask) {
+        map_entry* entry = &this->entries[this->slots[slot]];
+        if (entry->hash == hash && !entry->deleted && same_value_zero(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+map_entry* map_find(map* this, unknown key) {
+    return map_find_hashed(this, key, hash_key(key));
+}
+
+bool map_has(map* this, unknown key) {
+    return map_find(this, key) != NULL;
+}
+
+unknown map_get(map* this, unknown key) {
+    map_entry* entry = map_find(this, key);
+    return entry == NULL ? create_union_from_undefined(NULL) : entry->value;
+}
+
+map* map_set(map* this, unknown key, unknown value) {
+    uint32_t hash = hash_key(key);
+    map_entry* entry = map_find_hashed(this, key, hash);
+    if (entry != NULL) {
+        entry->value = value;
+        return this;
+    }
+    if (this->used == this->capacity) {
+        map_rebuild(this);
+    }
+    // the spec stores -0 keys as 0
+    if (union_type(key) == NUMBER_TAG && union_to_number(key) == 0) {
+        key = create_union_from_number(0);
+    }
+    uint32_t index = this->used++;
+    entry = &this->entries[index];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    entry->deleted = false;
+    entry->order = this->next_order++;
+    uint32_t slot = hash & this->mask;
+    while (this->slots[slot] != MAP_EMPTY_SLOT) {
+        slot = (slot + 1) & this->mask;
+    }
+    this->slots[slot] = index;
+    this->size++;
+    return this;
+}
+
+// the slot keeps pointing at the deleted entry until the next rebuild, so probe chains stay intact
+bool map_delete(map* this, unknown key) {
+    map_entry* entry = map_find(this, key);
+    if (entry == NULL) {
+        return false;
+    }
+    entry->deleted = true;
+    entry->key = create_union_from_undefined(NULL);
+    entry->value = create_union_from_undefined(NULL);
+    this->size--;
+    return true;
+}
+
+void map_clear(map* this) {
+    this->size = 0;
+    this->used = 0;
+    map_alloc(this, MAP_MIN_CAPACITY);
+    this->epoch++;
+}
+
+map_iterator map_iterate(map* this) {
+    return (map_iterator){.map = this, .index = 0, .epoch = this->epoch, .last_order = 0};
+}
+
+bool map_iterator_next(map_iterator* this, unknown* key, unknown* value) {
+    map* m = this->map;
+    if (this->epoch != m->epoch) {
+        // entries are sorted by order, so find the first one after the last entry this returned
+        uint32_t low = 0;
+        uint32_t high = m->used;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if (m->entries[mid].order < this->last_order) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        this->index = low;
+        this->epoch = m->epoch;
+    }
+    while (this->index < m->used) {
+        map_entry* entry = &m->entries[this->index++];
+        if (!entry->deleted) {
+            this->last_order = entry->order + 1;
+            *key = entry->key;
+            *value = entry->value;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+
+#ifndef NEUTRINO_CORE_MAP_H
+#define NEUTRINO_CORE_MAP_H
+
+#include "../types.h"
+#include "unknown.h"
+
+
+#define MAP_MIN_CAPACITY 8
+#define MAP_EMPTY_SLOT -1
+
+// keys are compared with SameValueZero, so -0 and 0 are the same key and so is NaN
+uint32_t hash_key(unknown key);
+bool same_value_zero(unknown x, unknown y);
+
+map* create_map(void);
+// returns the entry for key, or NULL
+map_entry* map_find(map* this, unknown key);
+bool map_has(map* this, unknown key);
+unknown map_get(map* this, unknown key);
+map* map_set(map* this, unknown key, unknown value);
+bool map_delete(map* this, unknown key);
+void map_clear(map* this);
+
+#define create_set() create_map()
+#define set_has map_has
+#define set_delete map_delete
+#define set_clear map_clear
+#define set_add(this, value) map_set(this, value, value)
+
+// iteration sees entries added while it runs and skips deleted ones, as the spec requires
+map_iterator map_iterate(map* this);
+// returns false when done, entries are inserted in key order so a set gets its values as keys
+bool map_iterator_next(map_iterator* this, unknown* key, unknown* value);
+
+#endif
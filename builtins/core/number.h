@@ -0,0 +1,28 @@
+
+#ifndef NEUTRINO_CORE_NUMBER_H
+#define NEUTRINO_CORE_NUMBER_H
+
+#include <stdint.h>
+#include <math.h>
+
+
+// ToUint32 and ToInt32, what the bitwise operators and the integer typed arrays do to a number
+// NaN and the infinities become 0 and everything else is truncated and wraps modulo 2^32
+static inline uint32_t to_uint32(double value) {
+    if (value >= 0 && value < 4294967296.0) {
+        return (uint32_t)value;
+    } else if (!isfinite(value)) {
+        return 0;
+    }
+    // exact, and within an int64_t
+    return (uint32_t)(int64_t)fmod(trunc(value), 4294967296.0);
+}
+
+static inline int32_t to_int32(double value) {
+    if (value > -2147483649.0 && value < 2147483648.0) {
+        return (int32_t)value;
+    }
+    return (int32_t)to_uint32(value);
+}
+
+#endif
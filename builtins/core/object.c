@@ -0,0 +1,230 @@
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include "../types.h"
+#include "gc.h"
+#include "atom.h"
+#include "string.h"
+#include "object.h"
+
+
+uint32_t shape_epoch = 0;
+
+shape* null_root_shape = NULL;
+
+
+shape* create_shape(shape* parent, object* proto, atom key, uint8_t flags) {
+    shape* out = gc_malloc_typed(&shape_gc_type);
+    out->parent = parent;
+    out->prototype = proto;
+    out->key = key;
+    out->flags = flags;
+    out->length = parent == NULL ? 0 : parent->length + 1;
+    out->transitions = NULL;
+    out->own_cache_key = 0;
+    out->own_cache_slot = SHAPE_NOT_FOUND;
+    out->proto_cache_key = 0;
+    out->proto_cache_holder = NULL;
+    out->proto_cache_slot = SHAPE_NOT_FOUND;
+    out->proto_cache_epoch = 0;
+    return out;
+}
+
+shape* get_root_shape(object* proto) {
+    if (proto == NULL) {
+        if (null_root_shape == NULL) {
+            null_root_shape = create_shape(NULL, NULL, 0, 0);
+        }
+        return null_root_shape;
+    }
+    if (proto->instance_shape == NULL) {
+        proto->instance_shape = create_shape(NULL, proto, 0, 0);
+    }
+    return proto->instance_shape;
+}
+
+shape* shape_add_key(shape* this, atom key, uint8_t flags) {
+    for (shape_transition* tr = this->transitions; tr != NULL; tr = tr->next) {
+        if (tr->shape->key == key && tr->shape->flags == flags) {
+            return tr->shape;
+        }
+    }
+    shape* out = create_shape(this, this->prototype, key, flags);
+    shape_transition* tr = malloc(sizeof(shape_transition));
+    tr->shape = out;
+    tr->next = this->transitions;
+    this->transitions = tr;
+    return out;
+}
+
+uint32_t shape_find(shape* this, atom key) {
+    for (shape* s = this; s->parent != NULL; s = s->parent) {
+        if (s->key == key) {
+            return s->length - 1;
+        }
+    }
+    return SHAPE_NOT_FOUND;
+}
+
+
+// makes room for length slots, keeping the first live ones
+static void ensure_capacity(object* this, uint32_t live, uint32_t length) {
+    if (length <= this->capacity) {
+        return;
+    }
+    uint32_t capacity = this->capacity * 2;
+    if (capacity < length) {
+        capacity = length;
+    }
+    any* slots = malloc(sizeof(any) * capacity);
+    memcpy(slots, this->slots, sizeof(any) * live);
+    this->slots = slots;
+    this->capacity = capacity;
+}
+
+object* create_object_with_shape(shape* shape) {
+    object* out = malloc(sizeof(object));
+    out->shape = shape;
+    out->instance_shape = NULL;
+    out->capacity = OBJECT_INLINE_SLOTS;
+    out->slots = out->inline_slots;
+    // nothing has been stored yet, so there is nothing to copy
+    ensure_capacity(out, 0, shape->length);
+    return out;
+}
+
+object* create_object(object* proto, int length, ...) {
+    object* out = create_object_with_shape(get_root_shape(proto));
+    va_list args;
+    va_start(args, length);
+    for (int i = 0; i < length; i++) {
+        atom key = va_arg(args, atom);
+        any value = va_arg(args, any);
+        set_object_atom(out, key, value);
+    }
+    va_end(args);
+    return out;
+}
+
+
+any get_object_key(object* this, atom key) {
+    shape* s = this->shape;
+    uint32_t slot = shape_find(s, key);
+    if (slot != SHAPE_NOT_FOUND) {
+        s->own_cache_key = key;
+        s->own_cache_slot = slot;
+        return this->slots[slot];
+    }
+    if (s->proto_cache_key == key && s->proto_cache_epoch == shape_epoch) {
+        return s->proto_cache_holder ? s->proto_cache_holder->slots[s->proto_cache_slot] : (any){.undefined = NULL};
+    }
+    object* holder = s->prototype;
+    while (holder != NULL) {
+        slot = shape_find(holder->shape, key);
+        if (slot != SHAPE_NOT_FOUND) {
+            break;
+        }
+        holder = holder->shape->prototype;
+    }
+    s->proto_cache_key = key;
+    s->proto_cache_holder = holder;
+    s->proto_cache_slot = slot;
+    s->proto_cache_epoch = shape_epoch;
+    return holder ? holder->slots[slot] : (any){.undefined = NULL};
+}
+
+void set_object_key(object* this, atom key, any value) {
+    shape* s = this->shape;
+    uint32_t slot = shape_find(s, key);
+    if (slot != SHAPE_NOT_FOUND) {
+        s->own_cache_key = key;
+        s->own_cache_slot = slot;
+        this->slots[slot] = value;
+        return;
+    }
+    s = shape_add_key(s, key, 0);
+    ensure_capacity(this, this->shape->length, s->length);
+    this->shape = s;
+    this->slots[s->length - 1] = value;
+    if (this->instance_shape != NULL) {
+        shape_epoch++;
+    }
+}
+
+bool has_object_atom(object* this, atom key) {
+    return shape_find(this->shape, key) != SHAPE_NOT_FOUND;
+}
+
+// rebuilds the shape of this on top of root, skipping the slot skip (or nothing if SHAPE_NOT_FOUND)
+static void reshape_object(object* this, shape* root, uint32_t skip) {
+    shape* old = this->shape;
+    uint32_t length = old->length;
+    shape** chain = malloc(sizeof(shape*) * (length + 1));
+    for (shape* s = old; s->parent != NULL; s = s->parent) {
+        chain[s->length - 1] = s;
+    }
+    any* old_slots = this->slots;
+    any* slots = length <= OBJECT_INLINE_SLOTS ? this->inline_slots : malloc(sizeof(any) * length);
+    if (slots == old_slots) {
+        any* copy = malloc(sizeof(any) * length);
+        memcpy(copy, old_slots, sizeof(any) * length);
+        old_slots = copy;
+    }
+    shape* s = root;
+    for (uint32_t i = 0; i < length; i++) {
+        if (i == skip) {
+            continue;
+        }
+        s = shape_add_key(s, chain[i]->key, chain[i]->flags);
+        slots[s->length - 1] = old_slots[i];
+    }
+    this->shape = s;
+    this->slots = slots;
+    this->capacity = length <= OBJECT_INLINE_SLOTS ? OBJECT_INLINE_SLOTS : length;
+    if (this->instance_shape != NULL) {
+        shape_epoch++;
+    }
+}
+
+bool delete_object_atom(object* this, atom key) {
+    uint32_t slot = shape_find(this->shape, key);
+    if (slot == SHAPE_NOT_FOUND) {
+        return false;
+    }
+    reshape_object(this, get_root_shape(this->shape->prototype), slot);
+    return true;
+}
+
+object* get_object_prototype(object* this) {
+    return this->shape->prototype;
+}
+
+void set_object_prototype(object* this, object* proto) {
+    if (this->shape->prototype != proto) {
+        reshape_object(this, get_root_shape(proto), SHAPE_NOT_FOUND);
+    }
+}
+
+
+object* object_prototype;
+
+// methods are function values, so they take the env of their closure like generated functions do
+char* object_prototype_toString(void* closure_env, object* this) {
+    return STRING_LITERAL("[object Object]");
+}
+
+object* object_prototype_valueOf(void* closure_env, object* this) {
+    return this;
+}
+
+static closure object_prototype_toString_closure CLOSURE_ALIGNED = {(void*)object_prototype_toString, NULL};
+static closure object_prototype_valueOf_closure CLOSURE_ALIGNED = {(void*)object_prototype_valueOf, NULL};
+
+void init_object(void) {
+    object_prototype = create_object(NULL, 2,
+        intern("toString"), (any){.function = &object_prototype_toString_closure},
+        intern("valueOf"), (any){.function = &object_prototype_valueOf_closure}
+    );
+}
@@ -0,0 +1,69 @@
+
+#ifndef NEUTRINO_CORE_OBJECT_H
+#define NEUTRINO_CORE_OBJECT_H
+
+#include <stdarg.h>
+#include "../types.h"
+#include "atom.h"
+
+
+#define SHAPE_NOT_FOUND UINT32_MAX
+
+// bumped whenever an object that is used as a prototype changes shape, invalidates every proto_cache_*
+extern uint32_t shape_epoch;
+
+shape* get_root_shape(object* proto);
+shape* shape_add_key(shape* this, atom key, uint8_t flags);
+uint32_t shape_find(shape* this, atom key);
+
+object* create_object(object* proto, int length, ...);
+object* create_object_with_shape(shape* shape);
+
+any get_object_key(object* this, atom key);
+void set_object_key(object* this, atom key, any value);
+bool has_object_atom(object* this, atom key);
+bool delete_object_atom(object* this, atom key);
+
+object* get_object_prototype(object* this);
+void set_object_prototype(object* this, object* proto);
+
+
+static inline any get_object_atom(object* this, atom key) {
+    shape* s = this->shape;
+    if (s->own_cache_key == key) {
+        return this->slots[s->own_cache_slot];
+    }
+    if (s->proto_cache_key == key && s->proto_cache_epoch == shape_epoch) {
+        return s->proto_cache_holder ? s->proto_cache_holder->slots[s->proto_cache_slot] : (any){.undefined = NULL};
+    }
+    return get_object_key(this, key);
+}
+
+static inline void set_object_atom(object* this, atom key, any value) {
+    shape* s = this->shape;
+    if (s->own_cache_key == key) {
+        this->slots[s->own_cache_slot] = value;
+    } else {
+        set_object_key(this, key, value);
+    }
+}
+
+// symbols are atoms, string keys are interned on the way in
+#define get_object_symbol get_object_atom
+#define set_object_symbol set_object_atom
+#define has_object_symbol has_object_atom
+#define delete_object_symbol delete_object_atom
+
+#define get_object_string(this, key) get_object_atom(this, intern_string(key))
+#define set_object_string(this, key, value) set_object_atom(this, intern_string(key), value)
+#define has_object_string(this, key) has_object_atom(this, intern_string(key))
+#define delete_object_string(this, key) delete_object_atom(this, intern_string(key))
+
+
+extern object* object_prototype;
+char* object_prototype_toString(void* closure_env, object* this);
+object* object_prototype_valueOf(void* closure_env, object* this);
+
+void init_object(void);
+
+#endif
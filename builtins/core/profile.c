@@ -0,0 +1,45 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../types.h"
+#include "profile.h"
+
+
+static profile_site* profile_sites = NULL;
+
+// one line per site and argument, the name, the argument and a count per tag
+// runs append, the compiler adds the counts up
+static void profile_write(void) {
+    char* path = getenv("NEUTRINO_PROFILE_OUT");
+    FILE* out = fopen(path ? path : "neutrino.profile", "a");
+    if (out == NULL) {
+        fprintf(stderr, "NeutrinoError: cannot write type profile\n");
+        return;
+    }
+    for (profile_site* site = profile_sites; site != NULL; site = site->next) {
+        for (int arg = 0; arg < PROFILE_MAX_ARGS; arg++) {
+            uint64_t total = 0;
+            for (int tag = 0; tag < PROFILE_TAGS; tag++) {
+                total += site->counts[arg][tag];
+            }
+            if (total == 0) {
+                continue;
+            }
+            fprintf(out, "%s %d", site->name, arg);
+            for (int tag = 0; tag < PROFILE_TAGS; tag++) {
+                fprintf(out, " %" PRIu64, site->counts[arg][tag]);
+            }
+            fputc('\n', out);
+        }
+    }
+    fclose(out);
+}
+
+void profile_register(profile_site* site) {
+    if (profile_sites == NULL) {
+        atexit(profile_write);
+    }
+    site->registered = true;
+    site->next = profile_sites;
+    profile_sites = site;
+}
@@ -0,0 +1,30 @@
+
+#ifndef NEUTRINO_CORE_PROFILE_H
+#define NEUTRINO_CORE_PROFILE_H
+
+#include "../types.h"
+#include "unknown.h"
+
+
+#define PROFILE_MAX_ARGS 2
+#define PROFILE_TAGS (ARRAY_TAG + 1)
+
+// one per instrumented union function call site, counts the tags each union argument had
+// instrumented builds write every site to NEUTRINO_PROFILE_OUT (or neutrino.profile) when they exit, see Compiler.runPGO
+typedef struct profile_site {
+    const char* name;
+    bool registered;
+    uint64_t counts[PROFILE_MAX_ARGS][PROFILE_TAGS];
+    struct profile_site* next;
+} profile_site;
+
+void profile_register(profile_site* site);
+
+static inline void profile_union(profile_site* site, int arg, unknown value) {
+    if (!site->registered) {
+        profile_register(site);
+    }
+    site->counts[arg][union_type(value)]++;
+}
+
+#endif
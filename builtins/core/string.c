@@ -0,0 +1,412 @@
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include "../types.h"
+#include "gc.h"
+#include "array.h"
+#include "string.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+char* alloc_string(uint32_t length) {
+    full_string* out = malloc_atomic(sizeof(full_string) + length + 1);
+    out->length = length;
+    out->hash = 0;
+    out->flags = 0;
+    out->data[length] = '\0';
+    return out->data;
+}
+
+char* create_string(char* data, uint32_t length) {
+    char* out = alloc_string(length);
+    memcpy(out, data, length);
+    return out;
+}
+
+char* string_from_c(char* value) {
+    return create_string(value, strlen(value));
+}
+
+// FNV-1a
+uint32_t hash_bytes(char* data, uint32_t length) {
+    uint32_t hash = 2166136261U;
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619U;
+    }
+    return hash;
+}
+
+int string_compare(char* x, char* y) {
+    uint32_t xl = string_length(x);
+    uint32_t yl = string_length(y);
+    int out = memcmp(x, y, xl < yl ? xl : yl);
+    if (out != 0) {
+        return out;
+    }
+    return xl < yl ? -1 : (xl > yl ? 1 : 0);
+}
+
+// bytes find_bytes may spend comparing candidates that pass the first/last byte filter but don't match before it gives up on it,
+// each miss is charged the whole needle so the filter stays linear in the haystack however long the needle is
+#define FILTER_BYTE_BUDGET(length) (256 + (uint64_t)(length))
+
+// Two-Way (Crochemore-Perrin), linear in the worst case, used when the byte filter keeps missing
+static int64_t two_way_find(uint8_t* haystack, size_t haystack_length, uint8_t* needle, size_t length) {
+    size_t i, ip, jp, k, p, ms, p0, mem, mem0;
+    size_t shift[256];
+    uint8_t present[256] = {0};
+    for (i = 0; i < length; i++) {
+        present[needle[i]] = 1;
+        shift[needle[i]] = i + 1;
+    }
+    // maximal suffix under both orderings gives the critical factorization
+    ip = (size_t)-1;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < length) {
+        if (needle[ip + k] == needle[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (needle[ip + k] > needle[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    ms = ip;
+    p0 = p;
+    ip = (size_t)-1;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < length) {
+        if (needle[ip + k] == needle[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (needle[ip + k] < needle[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1) {
+        ms = ip;
+    } else {
+        p = p0;
+    }
+    if (memcmp(needle, needle + p, ms + 1) != 0) {
+        mem0 = 0;
+        p = (ms > length - ms - 1 ? ms : length - ms - 1) + 1;
+    } else {
+        mem0 = length - p;
+    }
+    mem = 0;
+    uint8_t* h = haystack;
+    uint8_t* end = haystack + haystack_length;
+    while ((size_t)(end - h) >= length) {
+        // skip by the last byte first
+        if (!present[h[length - 1]]) {
+            h += length;
+            mem = 0;
+            continue;
+        }
+        k = length - shift[h[length - 1]];
+        if (k != 0) {
+            h += k < mem ? mem : k;
+            mem = 0;
+            continue;
+        }
+        for (k = ms + 1 > mem ? ms + 1 : mem; k < length && needle[k] == h[k]; k++);
+        if (k < length) {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+        for (k = ms + 1; k > mem && needle[k - 1] == h[k - 1]; k--);
+        if (k <= mem) {
+            return h - haystack;
+        }
+        h += p;
+        mem = mem0;
+    }
+    return -1;
+}
+
+int64_t find_bytes(char* haystack, uint32_t haystack_length, char* needle, uint32_t needle_length) {
+    if (needle_length == 0) {
+        return 0;
+    } else if (needle_length > haystack_length) {
+        return -1;
+    } else if (needle_length == 1) {
+        char* found = memchr(haystack, needle[0], haystack_length);
+        return found == NULL ? -1 : found - haystack;
+    }
+    // compare the first and last byte of every candidate at once, then check the middle of the ones that pass
+    uint32_t last = haystack_length - needle_length;
+    uint64_t budget = FILTER_BYTE_BUDGET(haystack_length);
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i first_byte = _mm256_set1_epi8(needle[0]);
+    __m256i last_byte = _mm256_set1_epi8(needle[needle_length - 1]);
+    for (; i + 32 <= last + 1; i += 32) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(haystack + i));
+        __m256i y = _mm256_loadu_si256((__m256i*)(haystack + i + needle_length - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(x, first_byte), _mm256_cmpeq_epi8(y, last_byte)));
+#elif defined(__SSE2__)
+    __m128i first_byte = _mm_set1_epi8(needle[0]);
+    __m128i last_byte = _mm_set1_epi8(needle[needle_length - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i x = _mm_loadu_si128((__m128i*)(haystack + i));
+        __m128i y = _mm_loadu_si128((__m128i*)(haystack + i + needle_length - 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(x, first_byte), _mm_cmpeq_epi8(y, last_byte)));
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+        while (mask != 0) {
+            uint32_t j = i + __builtin_ctz(mask);
+            if (memcmp(haystack + j + 1, needle + 1, needle_length - 2) == 0) {
+                return j;
+            } else if (budget <= needle_length) {
+                int64_t out = two_way_find((uint8_t*)haystack + j, haystack_length - j, (uint8_t*)needle, needle_length);
+                return out < 0 ? -1 : j + out;
+            }
+            budget -= needle_length;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (haystack[i] == needle[0] && haystack[i + needle_length - 1] == needle[needle_length - 1]) {
+            if (memcmp(haystack + i + 1, needle + 1, needle_length - 2) == 0) {
+                return i;
+            } else if (budget <= needle_length) {
+                int64_t out = two_way_find((uint8_t*)haystack + i, haystack_length - i, (uint8_t*)needle, needle_length);
+                return out < 0 ? -1 : i + out;
+            }
+            budget -= needle_length;
+        }
+    }
+    return -1;
+}
+
+static uint32_t clamp_position(double position, uint32_t length) {
+    if (!(position > 0)) {
+        return 0;
+    }
+    return position >= length ? length : (uint32_t)position;
+}
+
+double string_indexOf(char* this, char* search, double position) {
+    uint32_t length = string_length(this);
+    uint32_t start = clamp_position(position, length);
+    int64_t out = find_bytes(this + start, length - start, search, string_length(search));
+    return out < 0 ? -1 : (double)(start + out);
+}
+
+bool string_includes(char* this, char* search, double position) {
+    return string_indexOf(this, search, position) >= 0;
+}
+
+char* string_replace(char* this, char* pattern, char* replacement) {
+    uint32_t length = string_length(this);
+    uint32_t pattern_length = string_length(pattern);
+    uint32_t replacement_length = string_length(replacement);
+    int64_t index = find_bytes(this, length, pattern, pattern_length);
+    if (index < 0) {
+        return this;
+    }
+    char* out = alloc_string(length - pattern_length + replacement_length);
+    memcpy(out, this, index);
+    memcpy(out + index, replacement, replacement_length);
+    memcpy(out + index + replacement_length, this + index + pattern_length, length - index - pattern_length);
+    return out;
+}
+
+// finds every non-overlapping match in one scan, so callers can allocate their output once at its final size
+static uint32_t find_all(char* haystack, uint32_t length, char* needle, uint32_t needle_length, uint32_t** out) {
+    uint32_t count = 0;
+    uint32_t capacity = 16;
+    uint32_t* matches = malloc_atomic(sizeof(uint32_t) * capacity);
+    int64_t found;
+    for (uint32_t i = 0; i <= length && (found = find_bytes(haystack + i, length - i, needle, needle_length)) >= 0; i += found + needle_length) {
+        if (count == capacity) {
+            uint32_t* grown = malloc_atomic(sizeof(uint32_t) * capacity * 2);
+            memcpy(grown, matches, sizeof(uint32_t) * capacity);
+            matches = grown;
+            capacity *= 2;
+        }
+        matches[count++] = i + found;
+    }
+    *out = matches;
+    return count;
+}
+
+char* string_replaceAll(char* this, char* pattern, char* replacement) {
+    uint32_t length = string_length(this);
+    uint32_t pattern_length = string_length(pattern);
+    uint32_t replacement_length = string_length(replacement);
+    if (pattern_length == 0) {
+        // the replacement goes before every character and at the end
+        char* out = alloc_string(length + (length + 1) * replacement_length);
+        char* pos = out;
+        for (uint32_t i = 0; i < length; i++) {
+            memcpy(pos, replacement, replacement_length);
+            pos += replacement_length;
+            *pos++ = this[i];
+        }
+        memcpy(pos, replacement, replacement_length);
+        return out;
+    }
+    uint32_t* matches;
+    uint32_t count = find_all(this, length, pattern, pattern_length, &matches);
+    if (count == 0) {
+        return this;
+    }
+    char* out = alloc_string(length - count * pattern_length + count * replacement_length);
+    char* pos = out;
+    uint32_t i = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        memcpy(pos, this + i, matches[n] - i);
+        pos += matches[n] - i;
+        memcpy(pos, replacement, replacement_length);
+        pos += replacement_length;
+        i = matches[n] + pattern_length;
+    }
+    memcpy(pos, this + i, length - i);
+    return out;
+}
+
+string_array* string_split(char* this, char* separator) {
+    uint32_t length = string_length(this);
+    uint32_t separator_length = string_length(separator);
+    if (separator_length == 0) {
+        string_array* out = create_string_array(length);
+        for (uint32_t i = 0; i < length; i++) {
+            out->items[i] = create_string(this + i, 1);
+        }
+        return out;
+    }
+    uint32_t* matches;
+    uint32_t count = find_all(this, length, separator, separator_length, &matches);
+    string_array* out = create_string_array(count + 1);
+    uint32_t i = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        out->items[n] = create_string(this + i, matches[n] - i);
+        i = matches[n] + separator_length;
+    }
+    out->items[count] = create_string(this + i, length - i);
+    return out;
+}
+
+char* stradd(char* x, char* y) {
+    uint32_t xl = string_length(x);
+    uint32_t yl = string_length(y);
+    char* out = alloc_string(xl + yl);
+    memcpy(out, x, xl);
+    memcpy(out + xl, y, yl);
+    return out;
+}
+
+char* string_concat(int count, ...) {
+    va_list args;
+    char* values[count];
+    uint32_t length = 0;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        values[i] = va_arg(args, char*);
+        length += string_length(values[i]);
+    }
+    va_end(args);
+    char* out = alloc_string(length);
+    char* pos = out;
+    for (int i = 0; i < count; i++) {
+        uint32_t part = string_length(values[i]);
+        memcpy(pos, values[i], part);
+        pos += part;
+    }
+    return out;
+}
+
+
+static rope* create_rope_leaf(char* value, uint32_t length) {
+    rope* out = gc_malloc_typed(&rope_gc_type);
+    out->length = length;
+    out->flat = value;
+    out->left = NULL;
+    out->right = NULL;
+    return out;
+}
+
+rope* rope_from_string(char* value) {
+    return create_rope_leaf(value, string_length(value));
+}
+
+rope* rope_concat(rope* x, rope* y) {
+    if (x == NULL || x->length == 0) {
+        return y;
+    } else if (y == NULL || y->length == 0) {
+        return x;
+    }
+    uint32_t length = x->length + y->length;
+    if (length < ROPE_MIN_NODE_LENGTH && x->flat != NULL && y->flat != NULL) {
+        char* out = alloc_string(length);
+        memcpy(out, x->flat, x->length);
+        memcpy(out + x->length, y->flat, y->length);
+        return create_rope_leaf(out, length);
+    }
+    rope* out = gc_malloc_typed(&rope_gc_type);
+    out->length = length;
+    out->flat = NULL;
+    out->left = x;
+    out->right = y;
+    return out;
+}
+
+rope* rope_append(rope* this, char* value) {
+    return rope_concat(this, rope_from_string(value));
+}
+
+// recurses into the shorter side and loops on the longer one, so the stack depth stays logarithmic
+static void rope_write(rope* this, char* out) {
+    while (this->flat == NULL) {
+        if (this->left->length <= this->right->length) {
+            rope_write(this->left, out);
+            out += this->left->length;
+            this = this->right;
+        } else {
+            rope_write(this->right, out + this->left->length);
+            this = this->left;
+        }
+    }
+    memcpy(out, this->flat, this->length);
+}
+
+char* rope_flatten(rope* this) {
+    if (this == NULL) {
+        return STRING_LITERAL("");
+    } else if (this->flat == NULL) {
+        char* out = alloc_string(this->length);
+        rope_write(this, out);
+        this->flat = out;
+        this->left = NULL;
+        this->right = NULL;
+    }
+    return this->flat;
+}
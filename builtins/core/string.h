@@ -0,0 +1,87 @@
+
+#ifndef NEUTRINO_CORE_STRING_H
+#define NEUTRINO_CORE_STRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include "../types.h"
+
+
+#define string_header(value) ((full_string*)((value) - offsetof(full_string, data)))
+
+// a string with a static header, the length is known at compile time
+#define STRING_LITERAL(value) ({ \
+    static struct __attribute__((aligned(16))) { \
+        uint32_t length; \
+        uint32_t hash; \
+        uint32_t flags; \
+        uint32_t reserved; \
+        char data[sizeof(value)]; \
+    } string_literal = {sizeof(value) - 1, 0, 0, 0, value}; \
+    string_literal.data; \
+})
+
+// concatenations shorter than this are copied into a new leaf instead of making a node
+#define ROPE_MIN_NODE_LENGTH 32
+
+// allocates a string of length bytes, the caller fills in the data
+char* alloc_string(uint32_t length);
+char* create_string(char* data, uint32_t length);
+// for NUL-terminated strings that come from C, such as argv
+char* string_from_c(char* value);
+
+uint32_t hash_bytes(char* data, uint32_t length);
+
+static inline uint32_t string_length(char* value) {
+    return string_header(value)->length;
+}
+
+static inline uint32_t string_hash(char* value) {
+    full_string* header = string_header(value);
+    if (header->hash == 0) {
+        uint32_t hash = hash_bytes(value, header->length);
+        header->hash = hash == 0 ? 1 : hash;
+    }
+    return header->hash;
+}
+
+static inline bool string_equals(char* x, char* y) {
+    if (x == y) {
+        return true;
+    }
+    full_string* xh = string_header(x);
+    full_string* yh = string_header(y);
+    if (xh->length != yh->length || (xh->hash != 0 && yh->hash != 0 && xh->hash != yh->hash)) {
+        return false;
+    }
+    return memcmp(x, y, xh->length) == 0;
+}
+
+// like strcmp, but embedded NULs compare as characters
+int string_compare(char* x, char* y);
+
+// returns the first index of needle in haystack or -1, vectorized with SSE2/AVX2 when the target has them
+int64_t find_bytes(char* haystack, uint32_t haystack_length, char* needle, uint32_t needle_length);
+
+double string_indexOf(char* this, char* search, double position);
+bool string_includes(char* this, char* search, double position);
+char* string_replace(char* this, char* pattern, char* replacement);
+char* string_replaceAll(char* this, char* pattern, char* replacement);
+string_array* string_split(char* this, char* separator);
+
+char* stradd(char* x, char* y);
+// joins count strings with a single allocation
+char* string_concat(int count, ...);
+
+rope* rope_from_string(char* value);
+rope* rope_concat(rope* x, rope* y);
+rope* rope_append(rope* this, char* value);
+char* rope_flatten(rope* this);
+
+// a rope variable that was never assigned is NULL, the empty string
+static inline uint32_t rope_length(rope* this) {
+    return this == NULL ? 0 : this->length;
+}
+
+#endif
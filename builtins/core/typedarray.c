@@ -0,0 +1,395 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include "../types.h"
+#include "gc.h"
+#include "typedarray.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+GC_TYPE(arraybuffer_gc_type, arraybuffer, offsetof(arraybuffer, data));
+// every view has the same layout, data points into buffer's bytes so it keeps them alive too
+GC_TYPE(view_gc_type, dataview, offsetof(dataview, data), offsetof(dataview, buffer));
+
+_Noreturn void range_error(const char* message) {
+    fprintf(stderr, "RangeError: %s\n", message);
+    exit(1);
+}
+
+static uint32_t to_length(double length, const char* message) {
+    if (!(length >= 0 && length <= UINT32_MAX) || length != trunc(length)) {
+        range_error(message);
+    }
+    return (uint32_t)length;
+}
+
+// a negative index counts from the end, NaN is 0
+static uint32_t relative_start(double index, uint32_t length) {
+    if (isnan(index)) {
+        return 0;
+    } else if (index < 0) {
+        index += length;
+        return index > 0 ? (uint32_t)index : 0;
+    }
+    return index < length ? (uint32_t)index : length;
+}
+
+// the same but a missing end is passed as NaN and means length
+static uint32_t relative_end(double index, uint32_t length) {
+    return isnan(index) ? length : relative_start(index, length);
+}
+
+arraybuffer* create_arraybuffer(double length) {
+    arraybuffer* out = gc_malloc_typed(&arraybuffer_gc_type);
+    out->length = to_length(length, "Invalid array buffer length");
+    // GC_malloc_atomic doesn't clear what it returns
+    out->data = malloc_atomic(out->length == 0 ? 1 : out->length);
+    memset(out->data, 0, out->length);
+    return out;
+}
+
+arraybuffer* arraybuffer_slice(arraybuffer* this, double start, double end) {
+    uint32_t first = relative_start(start, this->length);
+    uint32_t last = relative_end(end, this->length);
+    arraybuffer* out = create_arraybuffer(last > first ? last - first : 0);
+    memcpy(out->data, this->data + first, out->length);
+    return out;
+}
+
+static void* create_view(arraybuffer* buffer, uint32_t offset, uint32_t length) {
+    dataview* out = gc_malloc_typed(&view_gc_type);
+    out->length = length;
+    out->data = buffer->data + offset;
+    out->buffer = buffer;
+    out->offset = offset;
+    return out;
+}
+
+dataview* create_dataview(arraybuffer* buffer, double offset, double length) {
+    uint32_t start = to_length(offset, "Start offset is outside the bounds of the buffer");
+    if (start > buffer->length) {
+        range_error("Start offset is outside the bounds of the buffer");
+    }
+    uint32_t count = isnan(length) ? buffer->length - start : to_length(length, "Invalid DataView length");
+    if ((uint64_t)start + count > buffer->length) {
+        range_error("Invalid DataView length");
+    }
+    return create_view(buffer, start, count);
+}
+
+
+// the kernels work on raw elements, size is 1, 2, 4 or 8 and floating says whether to compare them as floats so -0 finds 0 and NaN finds nothing
+// the dispatch folds away since every caller passes constants
+
+// stores one vector of the repeated element then copies it over the range with unaligned stores
+static void fill_elements(void* data, uint32_t count, uint32_t size, const void* item) {
+    uint8_t* bytes = data;
+    size_t total = (size_t)count * size;
+    if (size == 1) {
+        memset(bytes, *(uint8_t*)item, total);
+        return;
+    }
+    uint8_t pattern[32];
+    for (uint32_t i = 0; i < 32; i += size) {
+        memcpy(pattern + i, item, size);
+    }
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i block = _mm256_loadu_si256((__m256i*)pattern);
+    for (; i + 32 <= total; i += 32) {
+        _mm256_storeu_si256((__m256i*)(bytes + i), block);
+    }
+#elif defined(__SSE2__)
+    __m128i block = _mm_loadu_si128((__m128i*)pattern);
+    for (; i + 16 <= total; i += 16) {
+        _mm_storeu_si128((__m128i*)(bytes + i), block);
+    }
+#endif
+    for (; i < total; i += size) {
+        memcpy(bytes + i, pattern, size);
+    }
+}
+
+#if defined(__AVX2__)
+#define FIND_LOOP(width, load, compare, movemask, shift) \
+    for (; i + (32 >> shift) <= count; i += 32 >> shift) { \
+        uint32_t mask = movemask(compare(load((void*)(data + i)), key)); \
+        if (mask != 0) { \
+            return i + (__builtin_ctz(mask) >> width); \
+        } \
+    }
+#elif defined(__SSE2__)
+#define FIND_LOOP(width, load, compare, movemask, shift) \
+    for (; i + (16 >> shift) <= count; i += 16 >> shift) { \
+        uint32_t mask = movemask(compare(load((void*)(data + i)), key)); \
+        if (mask != 0) { \
+            return i + (__builtin_ctz(mask) >> width); \
+        } \
+    }
+#endif
+
+static int64_t find_16(const uint16_t* data, uint32_t count, uint16_t item) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi16(item);
+    FIND_LOOP(1, _mm256_loadu_si256, _mm256_cmpeq_epi16, _mm256_movemask_epi8, 1)
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi16(item);
+    FIND_LOOP(1, _mm_loadu_si128, _mm_cmpeq_epi16, _mm_movemask_epi8, 1)
+#endif
+    for (; i < count; i++) {
+        if (data[i] == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int64_t find_32(const uint32_t* data, uint32_t count, uint32_t item) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32(item);
+    FIND_LOOP(2, _mm256_loadu_si256, _mm256_cmpeq_epi32, _mm256_movemask_epi8, 2)
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32(item);
+    FIND_LOOP(2, _mm_loadu_si128, _mm_cmpeq_epi32, _mm_movemask_epi8, 2)
+#endif
+    for (; i < count; i++) {
+        if (data[i] == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// SSE2 has no 64 bit integer compare, so without AVX2 this is left to the compiler
+static int64_t find_64(const uint64_t* data, uint32_t count, uint64_t item) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x(item);
+    FIND_LOOP(3, _mm256_loadu_si256, _mm256_cmpeq_epi64, _mm256_movemask_epi8, 3)
+#endif
+    for (; i < count; i++) {
+        if (data[i] == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if defined(__AVX2__)
+#define compare_ps(x, y) _mm256_cmp_ps(x, y, _CMP_EQ_OQ)
+#define compare_pd(x, y) _mm256_cmp_pd(x, y, _CMP_EQ_OQ)
+#endif
+
+// the masks have one bit per element here
+static int64_t find_float(const float* data, uint32_t count, float item) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256 key = _mm256_set1_ps(item);
+    FIND_LOOP(0, _mm256_loadu_ps, compare_ps, _mm256_movemask_ps, 2)
+#elif defined(__SSE2__)
+    __m128 key = _mm_set1_ps(item);
+    FIND_LOOP(0, _mm_loadu_ps, _mm_cmpeq_ps, _mm_movemask_ps, 2)
+#endif
+    for (; i < count; i++) {
+        if (data[i] == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int64_t find_double(const double* data, uint32_t count, double item) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256d key = _mm256_set1_pd(item);
+    FIND_LOOP(0, _mm256_loadu_pd, compare_pd, _mm256_movemask_pd, 3)
+#elif defined(__SSE2__)
+    __m128d key = _mm_set1_pd(item);
+    FIND_LOOP(0, _mm_loadu_pd, _mm_cmpeq_pd, _mm_movemask_pd, 3)
+#endif
+    for (; i < count; i++) {
+        if (data[i] == item) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int64_t find_elements(const void* data, uint32_t count, uint32_t size, bool floating, const void* item) {
+    switch (size) {
+        case 1: {
+            const uint8_t* found = memchr(data, *(uint8_t*)item, count);
+            return found == NULL ? -1 : found - (const uint8_t*)data;
+        }
+        case 2:
+            return find_16(data, count, *(uint16_t*)item);
+        case 4:
+            return floating ? find_float(data, count, *(float*)item) : find_32(data, count, *(uint32_t*)item);
+        default:
+            return floating ? find_double(data, count, *(double*)item) : find_64(data, count, *(uint64_t*)item);
+    }
+}
+
+
+// the element an indexOf argument has to equal, false when no element can equal it
+#define INTEGER_KEY(name, type, min, max) \
+    static bool name##_key(double item, type* out) { \
+        if (!(item >= min && item <= max) || item != trunc(item)) { \
+            return false; \
+        } \
+        *out = (type)item; \
+        return true; \
+    }
+
+#define FLOAT_KEY(name, type) \
+    static bool name##_key(double item, type* out) { \
+        *out = (type)item; \
+        return !isnan(item) && (double)*out == item; \
+    }
+
+#define BIGINT_KEY(name, type) \
+    static bool name##_key(type item, type* out) { \
+        *out = item; \
+        return true; \
+    }
+
+INTEGER_KEY(int8array, int8_t, INT8_MIN, INT8_MAX)
+INTEGER_KEY(uint8array, uint8_t, 0, UINT8_MAX)
+INTEGER_KEY(uint8clampedarray, uint8_t, 0, UINT8_MAX)
+INTEGER_KEY(int16array, int16_t, INT16_MIN, INT16_MAX)
+INTEGER_KEY(uint16array, uint16_t, 0, UINT16_MAX)
+INTEGER_KEY(int32array, int32_t, INT32_MIN, INT32_MAX)
+INTEGER_KEY(uint32array, uint32_t, 0, UINT32_MAX)
+BIGINT_KEY(bigint64array, int64_t)
+BIGINT_KEY(biguint64array, uint64_t)
+FLOAT_KEY(float32array, float)
+FLOAT_KEY(float64array, double)
+
+#define TYPED_ARRAY_FUNCS(name, type, value, floating, title) \
+    name* create_##name(double length) { \
+        uint32_t count = to_length(length, "Invalid typed array length"); \
+        if ((uint64_t)count * sizeof(type) > UINT32_MAX) { \
+            range_error("Invalid typed array length"); \
+        } \
+        return create_view(create_arraybuffer(count * sizeof(type)), 0, count); \
+    } \
+    \
+    /* a missing length is passed as NaN and means the rest of the buffer */ \
+    name* create_##name##_from_buffer(arraybuffer* buffer, double offset, double length) { \
+        uint32_t start = to_length(offset, "Start offset of " title " is outside the bounds of the buffer"); \
+        if (start % sizeof(type) != 0) { \
+            range_error("Start offset of " title " should be a multiple of the element size"); \
+        } else if (start > buffer->length) { \
+            range_error("Start offset of " title " is outside the bounds of the buffer"); \
+        } \
+        uint32_t count; \
+        if (isnan(length)) { \
+            if ((buffer->length - start) % sizeof(type) != 0) { \
+                range_error("Byte length of " title " should be a multiple of the element size"); \
+            } \
+            count = (buffer->length - start) / sizeof(type); \
+        } else { \
+            count = to_length(length, "Invalid typed array length"); \
+        } \
+        if ((uint64_t)start + (uint64_t)count * sizeof(type) > buffer->length) { \
+            range_error("Invalid typed array length"); \
+        } \
+        return create_view(buffer, start, count); \
+    } \
+    \
+    name* name##_subarray(name* this, double start, double end) { \
+        uint32_t first = relative_start(start, this->length); \
+        uint32_t last = relative_end(end, this->length); \
+        return create_view(this->buffer, this->offset + first * sizeof(type), last > first ? last - first : 0); \
+    } \
+    \
+    name* name##_slice(name* this, double start, double end) { \
+        uint32_t first = relative_start(start, this->length); \
+        uint32_t last = relative_end(end, this->length); \
+        name* out = create_##name(last > first ? last - first : 0); \
+        memcpy(out->data, this->data + first, out->length * sizeof(type)); \
+        return out; \
+    } \
+    \
+    name* name##_fill(name* this, value item, double start, double end) { \
+        uint32_t first = relative_start(start, this->length); \
+        uint32_t last = relative_end(end, this->length); \
+        type element = name##_from_value(item); \
+        if (last > first) { \
+            fill_elements(this->data + first, last - first, sizeof(type), &element); \
+        } \
+        return this; \
+    } \
+    \
+    /* the two can be views of the same buffer, memmove copies as if through a temporary like the spec does */ \
+    void name##_set(name* this, name* source, double offset) { \
+        uint32_t start = to_length(offset, "offset is out of bounds"); \
+        if ((uint64_t)start + source->length > this->length) { \
+            range_error("offset is out of bounds"); \
+        } \
+        memmove(this->data + start, source->data, source->length * sizeof(type)); \
+    } \
+    \
+    name* name##_copyWithin(name* this, double target, double start, double end) { \
+        uint32_t to = relative_start(target, this->length); \
+        uint32_t first = relative_start(start, this->length); \
+        uint32_t last = relative_end(end, this->length); \
+        if (last > first && to < this->length) { \
+            uint32_t count = last - first < this->length - to ? last - first : this->length - to; \
+            memmove(this->data + to, this->data + first, count * sizeof(type)); \
+        } \
+        return this; \
+    } \
+    \
+    double name##_indexOf(name* this, value item, double start) { \
+        uint32_t first = relative_start(start, this->length); \
+        type key; \
+        if (!name##_key(item, &key)) { \
+            return -1; \
+        } \
+        int64_t out = find_elements(this->data + first, this->length - first, sizeof(type), floating, &key); \
+        return out < 0 ? -1 : (double)(first + out); \
+    }
+
+// bigint arrays can't be set from numbers, that is a TypeError
+#define NUMBER_TYPED_ARRAY_FUNCS(name, type) \
+    void name##_set_number_array(name* this, number_array* source, double offset) { \
+        uint32_t start = to_length(offset, "offset is out of bounds"); \
+        if ((uint64_t)start + source->length > this->length) { \
+            range_error("offset is out of bounds"); \
+        } \
+        for (uint32_t i = 0; i < source->length; i++) { \
+            this->data[start + i] = name##_from_value(source->items[i]); \
+        } \
+    }
+
+TYPED_ARRAY_FUNCS(int8array, int8_t, double, false, "Int8Array")
+TYPED_ARRAY_FUNCS(uint8array, uint8_t, double, false, "Uint8Array")
+TYPED_ARRAY_FUNCS(uint8clampedarray, uint8_t, double, false, "Uint8ClampedArray")
+TYPED_ARRAY_FUNCS(int16array, int16_t, double, false, "Int16Array")
+TYPED_ARRAY_FUNCS(uint16array, uint16_t, double, false, "Uint16Array")
+TYPED_ARRAY_FUNCS(int32array, int32_t, double, false, "Int32Array")
+TYPED_ARRAY_FUNCS(uint32array, uint32_t, double, false, "Uint32Array")
+TYPED_ARRAY_FUNCS(bigint64array, int64_t, int64_t, false, "BigInt64Array")
+TYPED_ARRAY_FUNCS(biguint64array, uint64_t, uint64_t, false, "BigUint64Array")
+TYPED_ARRAY_FUNCS(float32array, float, double, true, "Float32Array")
+TYPED_ARRAY_FUNCS(float64array, double, double, true, "Float64Array")
+
+NUMBER_TYPED_ARRAY_FUNCS(int8array, int8_t)
+NUMBER_TYPED_ARRAY_FUNCS(uint8array, uint8_t)
+NUMBER_TYPED_ARRAY_FUNCS(uint8clampedarray, uint8_t)
+NUMBER_TYPED_ARRAY_FUNCS(int16array, int16_t)
+NUMBER_TYPED_ARRAY_FUNCS(uint16array, uint16_t)
+NUMBER_TYPED_ARRAY_FUNCS(int32array, int32_t)
+NUMBER_TYPED_ARRAY_FUNCS(uint32array, uint32_t)
+NUMBER_TYPED_ARRAY_FUNCS(float32array, float)
+NUMBER_TYPED_ARRAY_FUNCS(float64array, double)
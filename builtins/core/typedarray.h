@@ -0,0 +1,161 @@
+
+#ifndef NEUTRINO_CORE_TYPEDARRAY_H
+#define NEUTRINO_CORE_TYPEDARRAY_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "../types.h"
+#include "number.h"
+
+
+// prints a RangeError and exits, the runtime has no exceptions to throw it as
+_Noreturn void range_error(const char* message);
+
+arraybuffer* create_arraybuffer(double length);
+arraybuffer* arraybuffer_slice(arraybuffer* this, double start, double end);
+
+static inline int8_t int8array_from_value(double value) {
+    return (int8_t)(uint8_t)to_uint32(value);
+}
+
+static inline uint8_t uint8array_from_value(double value) {
+    return (uint8_t)to_uint32(value);
+}
+
+// ToUint8Clamp, rounds half to even
+static inline uint8_t uint8clampedarray_from_value(double value) {
+    if (!(value > 0)) {
+        return 0;
+    }
+    return value >= 255 ? 255 : (uint8_t)nearbyint(value);
+}
+
+static inline int16_t int16array_from_value(double value) {
+    return (int16_t)(uint16_t)to_uint32(value);
+}
+
+static inline uint16_t uint16array_from_value(double value) {
+    return (uint16_t)to_uint32(value);
+}
+
+static inline int32_t int32array_from_value(double value) {
+    return (int32_t)(uint32_t)to_uint32(value);
+}
+
+static inline uint32_t uint32array_from_value(double value) {
+    return (uint32_t)to_uint32(value);
+}
+
+static inline int64_t bigint64array_from_value(int64_t value) {
+    return value;
+}
+
+static inline uint64_t biguint64array_from_value(uint64_t value) {
+    return value;
+}
+
+static inline float float32array_from_value(double value) {
+    return (float)value;
+}
+
+static inline double float64array_from_value(double value) {
+    return value;
+}
+
+// value is what an element reads as, double for every kind but the bigint ones, empty is what an out of range get returns
+// fill, set, copyWithin and indexOf are the bulk operations, see typedarray.c for their kernels
+#define DECLARE_TYPED_ARRAY_FUNCS(name, type, value, empty) \
+    name* create_##name(double length); \
+    name* create_##name##_from_buffer(arraybuffer* buffer, double offset, double length); \
+    /* a new view over the same bytes */ \
+    name* name##_subarray(name* this, double start, double end); \
+    /* a copy in a new buffer */ \
+    name* name##_slice(name* this, double start, double end); \
+    name* name##_fill(name* this, value item, double start, double end); \
+    void name##_set(name* this, name* source, double offset); \
+    name* name##_copyWithin(name* this, double target, double start, double end); \
+    double name##_indexOf(name* this, value item, double start); \
+    /* the range is checked before the conversion, which is undefined for negative, NaN and too large doubles */ \
+    static inline value name##_get_index(name* this, double index) { \
+        return index >= 0 && index < this->length && (uint32_t)index == index ? (value)this->data[(uint32_t)index] : empty; \
+    } \
+    /* out of range writes are dropped */ \
+    static inline value name##_set_index(name* this, double index, value item) { \
+        if (index >= 0 && index < this->length && (uint32_t)index == index) { \
+            this->data[(uint32_t)index] = name##_from_value(item); \
+        } \
+        return item; \
+    }
+
+DECLARE_TYPED_ARRAY_FUNCS(int8array, int8_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(uint8array, uint8_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(uint8clampedarray, uint8_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(int16array, int16_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(uint16array, uint16_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(int32array, int32_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(uint32array, uint32_t, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(bigint64array, int64_t, int64_t, 0);
+DECLARE_TYPED_ARRAY_FUNCS(biguint64array, uint64_t, uint64_t, 0);
+DECLARE_TYPED_ARRAY_FUNCS(float32array, float, double, NaN);
+DECLARE_TYPED_ARRAY_FUNCS(float64array, double, double, NaN);
+
+// set from a number[], the bigint kinds can't be
+void int8array_set_number_array(int8array* this, number_array* source, double offset);
+void uint8array_set_number_array(uint8array* this, number_array* source, double offset);
+void uint8clampedarray_set_number_array(uint8clampedarray* this, number_array* source, double offset);
+void int16array_set_number_array(int16array* this, number_array* source, double offset);
+void uint16array_set_number_array(uint16array* this, number_array* source, double offset);
+void int32array_set_number_array(int32array* this, number_array* source, double offset);
+void uint32array_set_number_array(uint32array* this, number_array* source, double offset);
+void float32array_set_number_array(float32array* this, number_array* source, double offset);
+void float64array_set_number_array(float64array* this, number_array* source, double offset);
+
+dataview* create_dataview(arraybuffer* buffer, double offset, double length);
+
+static inline uint8_t* dataview_at(dataview* this, double offset, uint32_t size) {
+    if (!(offset >= 0 && offset + size <= this->length) || (uint32_t)offset != offset) {
+        range_error("Offset is outside the bounds of the DataView");
+    }
+    return this->data + (uint32_t)offset;
+}
+
+// every access is one unaligned load or store through memcpy, plus a byte swap when it isn't little endian
+#define DATAVIEW_FUNCS(method, type, bits, value, from_value) \
+    static inline value dataview_get##method(dataview* this, double offset, bool little_endian) { \
+        uint##bits##_t raw; \
+        memcpy(&raw, dataview_at(this, offset, sizeof(raw)), sizeof(raw)); \
+        if (!little_endian) { \
+            raw = DATAVIEW_BSWAP##bits(raw); \
+        } \
+        type out; \
+        memcpy(&out, &raw, sizeof(out)); \
+        return (value)out; \
+    } \
+    static inline void dataview_set##method(dataview* this, double offset, value item, bool little_endian) { \
+        type in = from_value(item); \
+        uint##bits##_t raw; \
+        memcpy(&raw, &in, sizeof(raw)); \
+        if (!little_endian) { \
+            raw = DATAVIEW_BSWAP##bits(raw); \
+        } \
+        memcpy(dataview_at(this, offset, sizeof(raw)), &raw, sizeof(raw)); \
+    }
+
+#define DATAVIEW_BSWAP8(x) (x)
+#define DATAVIEW_BSWAP16 __builtin_bswap16
+#define DATAVIEW_BSWAP32 __builtin_bswap32
+#define DATAVIEW_BSWAP64 __builtin_bswap64
+
+DATAVIEW_FUNCS(Int8, int8_t, 8, double, int8array_from_value)
+DATAVIEW_FUNCS(Uint8, uint8_t, 8, double, uint8array_from_value)
+DATAVIEW_FUNCS(Int16, int16_t, 16, double, int16array_from_value)
+DATAVIEW_FUNCS(Uint16, uint16_t, 16, double, uint16array_from_value)
+DATAVIEW_FUNCS(Int32, int32_t, 32, double, int32array_from_value)
+DATAVIEW_FUNCS(Uint32, uint32_t, 32, double, uint32array_from_value)
+DATAVIEW_FUNCS(Float32, float, 32, double, float32array_from_value)
+DATAVIEW_FUNCS(Float64, double, 64, double, float64array_from_value)
+DATAVIEW_FUNCS(BigInt64, int64_t, 64, int64_t, bigint64array_from_value)
+DATAVIEW_FUNCS(BigUint64, uint64_t, 64, uint64_t, biguint64array_from_value)
+
+#endif
@@ -0,0 +1,198 @@
+
+#ifndef NEUTRINO_CORE_UNKNOWN_H
+#define NEUTRINO_CORE_UNKNOWN_H
+
+#include <string.h>
+#include "../types.h"
+
+
+#ifdef NEUTRINO_NAN_BOXING
+
+/*
+NaN-boxed values, passed around by value in a single register:
+- top 16 bits zero: a heap pointer with its tag in the low 4 bits, or an immediate (undefined, null, boolean,
+  symbol) with its payload shifted left by 4. Heap pointers stay within their allocation, so the conservative
+  collector still sees them as interior pointers.
+- anything else: a double, offset by 2^48 so that it can never have its top 16 bits zero. NaNs are
+  canonicalized first so that the offset cannot overflow.
+*/
+
+#define UNKNOWN_DOUBLE_OFFSET ((uint64_t)1 << 48)
+#define UNKNOWN_TAG_MASK ((uint64_t)0xf)
+
+static inline unknown unknown_from_bits(uint64_t bits) {
+    return (unknown){.bits = bits};
+}
+
+static inline unknown unknown_from_pointer(void* value, uint8_t tag) {
+    return (unknown){.bits = (uint64_t)(uintptr_t)value | tag};
+}
+
+static inline bool unknown_is_number(unknown value) {
+    return (value.bits >> 48) != 0;
+}
+
+static inline uint8_t unknown_type(unknown value) {
+    return unknown_is_number(value) ? NUMBER_TAG : (uint8_t)(value.bits & UNKNOWN_TAG_MASK);
+}
+
+static inline double unknown_to_number(unknown value) {
+    double out;
+    uint64_t bits = value.bits - UNKNOWN_DOUBLE_OFFSET;
+    memcpy(&out, &bits, sizeof(double));
+    return out;
+}
+
+static inline void* unknown_to_pointer(unknown value) {
+    return (void*)(uintptr_t)(value.bits & ~UNKNOWN_TAG_MASK);
+}
+
+static inline object* unknown_to_object(unknown value) {
+    return unknown_to_pointer(value);
+}
+
+static inline unknown create_unknown_from_undefined(void* value) {
+    return unknown_from_bits(UNDEFINED_TAG);
+}
+
+static inline unknown create_unknown_from_null(void* value) {
+    return unknown_from_bits(NULL_TAG);
+}
+
+static inline unknown create_unknown_from_boolean(bool value) {
+    return unknown_from_bits(((uint64_t)value << 4) | BOOLEAN_TAG);
+}
+
+static inline unknown create_unknown_from_number(double value) {
+    uint64_t bits;
+    if (value != value) {
+        bits = 0x7ff8000000000000;
+    } else {
+        memcpy(&bits, &value, sizeof(double));
+    }
+    return unknown_from_bits(bits + UNKNOWN_DOUBLE_OFFSET);
+}
+
+// the full_string header keeps string data 16-byte aligned, see types.h
+static inline unknown create_unknown_from_string(char* value) {
+    return unknown_from_pointer(value, STRING_TAG);
+}
+
+static inline unknown create_unknown_from_symbol(symbol value) {
+    return unknown_from_bits((value << 4) | SYMBOL_TAG);
+}
+
+static inline unknown create_unknown_from_bigint(bigint* value) {
+    return unknown_from_pointer(value, BIGINT_TAG);
+}
+
+static inline unknown create_unknown_from_object(object* value) {
+    return unknown_from_pointer(value, OBJECT_TAG);
+}
+
+// function values are closure records, not code pointers, which have no alignment to spare for the tag
+static inline unknown create_unknown_from_function(closure* value) {
+    return unknown_from_pointer(value, FUNCTION_TAG);
+}
+
+static inline unknown create_unknown_from_proxy(proxy* value) {
+    return unknown_from_pointer(value, PROXY_TAG);
+}
+
+static inline unknown create_unknown_from_array(array* value) {
+    return unknown_from_pointer(value, ARRAY_TAG);
+}
+
+static inline unknown create_unknown_from_unknown(unknown value) {
+    return value;
+}
+
+static inline any unknown_to_any(unknown value) {
+    switch (unknown_type(value)) {
+        case NUMBER_TAG:
+            return (any){.number = unknown_to_number(value)};
+        case BOOLEAN_TAG:
+            return (any){.boolean = value.bits >> 4};
+        case SYMBOL_TAG:
+            return (any){.symbol = value.bits >> 4};
+        case UNDEFINED_TAG:
+        case NULL_TAG:
+            return (any){.undefined = NULL};
+        default:
+            return (any){.object = unknown_to_pointer(value)};
+    }
+}
+
+// union values are always unknowns passed by value, which with NaN-boxing is the same thing as an any
+#define union_type(value) unknown_type(value)
+#define union_to_number(value) unknown_to_number(value)
+#define union_to_any(value) unknown_to_any(value)
+#define union_to_unknown(value) (value)
+#define union_from_unknown(value) (value)
+#define union_to_temp_unknown(value) (value)
+
+#define create_union_from_undefined create_unknown_from_undefined
+#define create_union_from_null create_unknown_from_null
+#define create_union_from_boolean create_unknown_from_boolean
+#define create_union_from_number create_unknown_from_number
+#define create_union_from_string create_unknown_from_string
+#define create_union_from_symbol create_unknown_from_symbol
+#define create_union_from_bigint create_unknown_from_bigint
+#define create_union_from_object create_unknown_from_object
+#define create_union_from_function create_unknown_from_function
+#define create_union_from_proxy create_unknown_from_proxy
+#define create_union_from_array create_unknown_from_array
+
+// the C type of a value of type any
+typedef unknown any_value;
+
+#else
+
+typedef unknown* any_value;
+
+#define create_unknown(tag, member, x) ({unknown* out = malloc(sizeof(unknown)); out->type = tag; out->value.member = (x); out;})
+
+#define create_unknown_from_undefined(value) create_unknown(UNDEFINED_TAG, undefined, value)
+#define create_unknown_from_null(value) create_unknown(NULL_TAG, null, value)
+#define create_unknown_from_boolean(value) create_unknown(BOOLEAN_TAG, boolean, value)
+#define create_unknown_from_number(value) create_unknown(NUMBER_TAG, number, value)
+#define create_unknown_from_string(value) create_unknown(STRING_TAG, string, value)
+#define create_unknown_from_symbol(value) create_unknown(SYMBOL_TAG, symbol, value)
+#define create_unknown_from_bigint(value) create_unknown(BIGINT_TAG, bigint, value)
+#define create_unknown_from_object(value) create_unknown(OBJECT_TAG, object, value)
+#define create_unknown_from_function(value) create_unknown(FUNCTION_TAG, function, value)
+#define create_unknown_from_proxy(value) create_unknown(PROXY_TAG, proxy, value)
+#define create_unknown_from_array(value) create_unknown(ARRAY_TAG, array, value)
+#define create_unknown_from_unknown(value) (value)
+
+#define unknown_type(value) ((value)->type)
+#define unknown_to_number(x) ((x)->value.number)
+#define unknown_to_object(x) ((x)->value.object)
+#define unknown_to_any(x) ((x)->value)
+
+// union values are unknowns passed by value, so they never need a heap allocation unless they escape to any
+#define union_type(value) ((value).type)
+#define union_to_number(x) ((x).value.number)
+#define union_to_any(x) ((x).value)
+#define union_to_unknown(value) ({unknown* out = malloc(sizeof(unknown)); *out = (value); out;})
+#define union_from_unknown(value) (*(value))
+// for arguments the callee doesn't keep, it lives as long as the enclosing block
+#define union_to_temp_unknown(value) ((unknown[]){value})
+
+#define create_union(tag, member, x) ((unknown){.type = tag, .value.member = (x)})
+
+#define create_union_from_undefined(value) create_union(UNDEFINED_TAG, undefined, value)
+#define create_union_from_null(value) create_union(NULL_TAG, null, value)
+#define create_union_from_boolean(value) create_union(BOOLEAN_TAG, boolean, value)
+#define create_union_from_number(value) create_union(NUMBER_TAG, number, value)
+#define create_union_from_string(value) create_union(STRING_TAG, string, value)
+#define create_union_from_symbol(value) create_union(SYMBOL_TAG, symbol, value)
+#define create_union_from_bigint(value) create_union(BIGINT_TAG, bigint, value)
+#define create_union_from_object(value) create_union(OBJECT_TAG, object, value)
+#define create_union_from_function(value) create_union(FUNCTION_TAG, function, value)
+#define create_union_from_proxy(value) create_union(PROXY_TAG, proxy, value)
+#define create_union_from_array(value) create_union(ARRAY_TAG, array, value)
+
+#endif
+
+#endif
@@ -15,7 +15,8 @@
 } name;
 
 
-typedef uint64_t symbol;
+typedef uint64_t atom;
+typedef atom symbol;
 
 typedef union any {
     void* undefined;
@@ -26,36 +27,99 @@ typedef union any {
     symbol symbol;
     struct bigint* bigint;
     struct object* object;
-    union any* (*function)();
+    struct closure* function;
     struct proxy* proxy;
     struct array* array;
 } any;
 
+enum unknown_tag {
+    UNDEFINED_TAG = 1,
+    NULL_TAG,
+    BOOLEAN_TAG,
+    NUMBER_TAG,
+    STRING_TAG,
+    SYMBOL_TAG,
+    BIGINT_TAG,
+    OBJECT_TAG,
+    FUNCTION_TAG,
+    PROXY_TAG,
+    ARRAY_TAG,
+};
+
+#ifdef NEUTRINO_NAN_BOXING
+
+// see core/unknown.h for the encoding
+typedef struct unknown {
+    uint64_t bits;
+} unknown;
+
+#else
+
 typedef struct unknown {
     uint8_t type;
     any value;
 } unknown;
 
+#endif
+
 
 LIST_STRUCT(bigint, uint32_t, data);
 
+// every JS string is a char* to the data of one of these, so it still works as a C string
+// the header is 16 bytes so the data keeps malloc's alignment, which NaN-boxing relies on
+typedef struct full_string {
+    uint32_t length;
+    // 0 until string_hash computes it
+    uint32_t hash;
+    uint32_t flags;
+    uint32_t reserved;
+    char data[];
+} full_string;
+
+// a lazily concatenated string, either a leaf holding flat or a concatenation of left and right
+// flattening turns a concatenation into a leaf, so it only ever happens once per node
+typedef struct rope {
+    uint32_t length;
+    char* flat;
+    struct rope* left;
+    struct rope* right;
+} rope;
+
 typedef struct getter_setter {
     any* (*getter)();
     void (*setter)(any* value);
 } getter_setter;
 
-typedef struct property {
-    struct property* next;
-    uint64_t key;
+#define IS_ACCESSOR 1
+
+typedef struct shape_transition {
+    struct shape_transition* next;
+    struct shape* shape;
+} shape_transition;
+
+typedef struct shape {
+    struct shape* parent;
+    struct object* prototype;
+    atom key;
     uint8_t flags;
-    any value;
-} property;
+    uint32_t length;
+    shape_transition* transitions;
+    atom own_cache_key;
+    uint32_t own_cache_slot;
+    atom proto_cache_key;
+    struct object* proto_cache_holder;
+    uint32_t proto_cache_slot;
+    uint32_t proto_cache_epoch;
+} shape;
 
-#define IS_ACCESSOR 
+#define OBJECT_INLINE_SLOTS 4
 
 typedef struct object {
-    struct object* prototype;
-    property* data[16];
+    shape* shape;
+    shape* instance_shape;
+    uint32_t capacity;
+    any* slots;
+    any inline_slots[OBJECT_INLINE_SLOTS];
 } object;
 
 typedef struct proxy {
@@ -74,50 +138,102 @@ typedef struct proxy {
     void (*construct)(object* target, struct array* args);
 } proxy;
 
-typedef struct array {
+// a function value, the generated C function and the env of captured variables it was created with (NULL for most)
+// the function takes env first, then this and its parameters
+typedef struct closure {
+    void* func;
+    void* env;
+} closure;
+
+// NaN-boxing keeps the tag in the low 4 bits, the collector's allocations are aligned like this already but static closures have to ask
+#define CLOSURE_ALIGNED __attribute__((aligned(16)))
+
+// items points into a buffer with head free slots before it and capacity slots from items onwards,
+// so shift/unshift move items instead of the elements
+#define ARRAY_STRUCT(name, type) typedef struct name { \
+    uint32_t length; \
+    uint32_t capacity; \
+    uint32_t head; \
+    type* items; \
+} name;
+
+ARRAY_STRUCT(array, any*);
+
+// packed element kinds for number[], string[] and boolean[], only boxed when they flow into any
+ARRAY_STRUCT(number_array, double);
+ARRAY_STRUCT(string_array, char*);
+ARRAY_STRUCT(boolean_array, bool);
+
+// the bytes are allocated atomic, they never hold pointers
+typedef struct arraybuffer {
     uint32_t length;
-    any** items;
-} array;
-
-LIST_STRUCT(arraybuffer, int8_t, data);
-LIST_STRUCT(dataview, int8_t, data);
-LIST_STRUCT(int8array, int8_t, data);
-LIST_STRUCT(uint8array, uint8_t, data);
-LIST_STRUCT(int16array, int16_t, data);
-LIST_STRUCT(uint16array, uint16_t, data);
-LIST_STRUCT(int32array, int32_t, data);
-LIST_STRUCT(uint32array, uint32_t, data);
-LIST_STRUCT(bigint64array, uint8_t, data);
-LIST_STRUCT(biguint64array, uint8_t, data);
-LIST_STRUCT(float32array, float, data);
-LIST_STRUCT(float64array, double, data);
+    uint8_t* data;
+} arraybuffer;
+
+// typed arrays and DataViews are views of length elements from data, which points offset bytes into buffer
+// views made from the same buffer (or with subarray) share its bytes
+#define VIEW_STRUCT(name, type) typedef struct name { \
+    uint32_t length; \
+    type* data; \
+    arraybuffer* buffer; \
+    uint32_t offset; \
+} name;
+
+VIEW_STRUCT(dataview, uint8_t);
+VIEW_STRUCT(int8array, int8_t);
+VIEW_STRUCT(uint8array, uint8_t);
+VIEW_STRUCT(uint8clampedarray, uint8_t);
+VIEW_STRUCT(int16array, int16_t);
+VIEW_STRUCT(uint16array, uint16_t);
+VIEW_STRUCT(int32array, int32_t);
+VIEW_STRUCT(uint32array, uint32_t);
+VIEW_STRUCT(bigint64array, int64_t);
+VIEW_STRUCT(biguint64array, uint64_t);
+VIEW_STRUCT(float32array, float);
+VIEW_STRUCT(float64array, double);
 
 typedef double date;
 LIST_STRUCT(regexp, uint8_t, data);
 
-typedef struct map_item {
-    struct map_item* next;
-    any key;
-    any value;
-} map_item;
-
+// entries are kept in insertion order, deleted ones stay in place until the table is rebuilt
+typedef struct map_entry {
+    unknown key;
+    unknown value;
+    uint32_t hash;
+    bool deleted;
+    // increases with every insertion, lets iterators find their place again after a rebuild
+    uint64_t order;
+} map_entry;
+
+// open addressing with linear probing, slots hold indexes into entries
 typedef struct map {
-    map_item data[16];
+    uint32_t size;
+    uint32_t used;
+    uint32_t capacity;
+    uint32_t mask;
+    int32_t* slots;
+    map_entry* entries;
+    uint64_t next_order;
+    // bumped when entries are compacted
+    uint32_t epoch;
 } map;
 
-typedef struct set_item {
-    struct set_item* next;
-    any value;
-} set_item;
+// a set is a map whose values are unused
+typedef map set;
 
-typedef struct set {
-    set_item data[16];
-} set;
+typedef struct map_iterator {
+    map* map;
+    uint32_t index;
+    uint32_t epoch;
+    uint64_t last_order;
+} map_iterator;
 
 
-#define NaN ((number)NAN)
+#define NaN ((double)NAN)
 
 #define malloc(size) ({void* x = GC_malloc(size); if (x == NULL) fprintf(stderr, "FatalInternalError: malloc failed"); x;})
+// for memory that never holds a pointer (characters, numbers, hashes), the collector doesn't scan it and doesn't clear it
+#define malloc_atomic(size) ({void* x = GC_malloc_atomic(size); if (x == NULL) fprintf(stderr, "FatalInternalError: malloc failed"); x;})
 
 
 #endif
@@ -0,0 +1,154 @@
+
+import {join} from 'node:path';
+import * as fs from 'node:fs';
+import {createHash} from 'node:crypto';
+import {UnionType, UnionFuncCall} from './unions.js';
+
+
+// @ts-ignore
+export const VERSION: string = JSON.parse(fs.readFileSync(join(import.meta.dirname, '../package.json')).toString()).version;
+
+export const STRUCT_NAME = /\bstruct_[0-9a-z]+\b/g;
+
+export function hash(...parts: string[]): string {
+    let out = createHash('sha256');
+    for (let part of parts) {
+        out.update(part);
+        out.update('\0');
+    }
+    return out.digest('hex');
+}
+
+
+// the atoms and union functions some generated code needs from shared.c
+export interface SharedUsage {
+    atoms: Set<string>;
+    unionFuncCalls: UnionFuncCall[];
+    escapes: Set<string>;
+}
+
+export interface SerializedUsage {
+    atoms: string[];
+    unionFuncCalls: {func: UnionFuncCall['func'], args: (UnionType | UnionType[])[], hot?: (UnionType | null)[]}[];
+    escapes?: string[];
+}
+
+export function serializeUsage(usage: SharedUsage): SerializedUsage {
+    return {
+        atoms: Array.from(usage.atoms),
+        unionFuncCalls: usage.unionFuncCalls.map(call => ({func: call.func, args: call.args.map(arg => arg instanceof Set ? Array.from(arg) : arg), hot: call.hot})),
+        escapes: Array.from(usage.escapes),
+    };
+}
+
+export function deserializeUsage(usage: SerializedUsage): SharedUsage {
+    return {
+        atoms: new Set(usage.atoms),
+        unionFuncCalls: usage.unionFuncCalls.map(call => ({func: call.func, args: call.args.map(arg => Array.isArray(arg) ? new Set(arg) : arg), hot: call.hot})),
+        escapes: new Set(usage.escapes ?? []),
+    };
+}
+
+export interface ModuleEntry {
+    key: string;
+    code: string;
+    header: string;
+    usage: SerializedUsage;
+}
+
+export interface StructEntry {
+    signature: string;
+    name: string;
+    decl: string;
+    def: string;
+    usage: SerializedUsage;
+}
+
+/*
+a persistent cache in config.cacheDir, it holds
+- modules/<hash of path>.json: the generated C and header of a module, keyed by its source, the compiler version, the config and the ids and export types of what it imports
+- structs.json: the structs the modules use, so a struct keeps its name from build to build and cached modules can still refer to it, and the
+  escaped structs and array kinds, so cached modules are keyed by the same set they were generated with. It is only read back for the same
+  compiler version and config, and names are never reused, so a module cached by another build can't end up with a different struct.
+- builds.json: the hash of the objects that went into each binary, so it is only relinked when one changed
+*/
+export class BuildCache {
+
+    dir: string;
+    configHash: string;
+    structs: StructEntry[] = [];
+    escapes: string[] = [];
+    nextStructID: number = 0;
+    builds: {[path: string]: string} = {};
+
+    constructor(dir: string, config: object) {
+        this.dir = dir;
+        this.configHash = hash(VERSION, JSON.stringify(config));
+        fs.mkdirSync(join(dir, 'modules'), {recursive: true});
+        let structs = this.read('structs.json');
+        if (structs && structs.config === this.configHash) {
+            this.structs = structs.structs;
+            this.escapes = structs.escapes;
+            this.nextStructID = structs.nextID;
+        }
+        this.builds = this.read('builds.json') ?? {};
+    }
+
+    read(path: string): any {
+        try {
+            return JSON.parse(fs.readFileSync(join(this.dir, path)).toString());
+        } catch {
+            return null;
+        }
+    }
+
+    modulePath(path: string): string {
+        return join('modules', hash(path).slice(0, 32) + '.json');
+    }
+
+    moduleKey(code: string, id: string, deps: [string, string, string][], escapes: string[]): string {
+        return hash(this.configHash, code, id, ...deps.map(dep => dep.join('\0')), escapes.join(' '));
+    }
+
+    getModule(path: string, key: string): ModuleEntry | null {
+        let out: ModuleEntry | null = this.read(this.modulePath(path));
+        return out && out.key === key ? out : null;
+    }
+
+    setModule(path: string, entry: ModuleEntry): void {
+        fs.writeFileSync(join(this.dir, this.modulePath(path)), JSON.stringify(entry));
+    }
+
+    isBuilt(output: string, key: string): boolean {
+        return this.builds[output] === key && fs.existsSync(output);
+    }
+
+    setBuilt(output: string, key: string): void {
+        this.builds[output] = key;
+    }
+
+    // drops the structs that neither the code in used nor another struct that is kept refers to
+    pruneStructs(used: string[]): void {
+        let names = new Set(used.flatMap(code => code.match(STRUCT_NAME) ?? []));
+        let kept = new Set<StructEntry>();
+        let changed = true;
+        while (changed) {
+            changed = false;
+            for (let struct of this.structs) {
+                if (!kept.has(struct) && names.has(struct.name)) {
+                    kept.add(struct);
+                    (struct.decl + struct.def).match(STRUCT_NAME)?.forEach(name => names.add(name));
+                    changed = true;
+                }
+            }
+        }
+        this.structs = this.structs.filter(struct => kept.has(struct));
+        this.escapes = this.escapes.filter(name => !name.startsWith('struct_') || names.has(name));
+    }
+
+    save(): void {
+        fs.writeFileSync(join(this.dir, 'structs.json'), JSON.stringify({config: this.configHash, nextID: this.nextStructID, structs: this.structs, escapes: this.escapes}));
+        fs.writeFileSync(join(this.dir, 'builds.json'), JSON.stringify(this.builds));
+    }
+
+}
@@ -1,14 +1,16 @@
 
 import {join, resolve, dirname} from 'node:path';
 import * as fs from 'node:fs';
-import {execSync} from 'node:child_process';
+import {exec, spawn} from 'node:child_process';
+import {promisify} from 'node:util';
 import * as b from '@babel/types';
 import * as parser from '@babel/parser';
 import {t, Type, CompilerError, Scope, changeExtension} from './util.js';
 import {Config, loadConfig} from './config.js';
 import {Inferrer} from './inferrer.js';
-import {UnionFuncCall, createUnionFunc} from './unions.js';
+import {UnionType, UnionFuncCall, TAGGED_TYPES, unionFuncCallsAreEqual, createUnionFunc} from './unions.js';
 import {Generator} from './generator.js';
+import {SharedUsage, BuildCache, STRUCT_NAME, VERSION, serializeUsage, deserializeUsage, hash} from './cache.js';
 
 
 export interface File {
@@ -22,6 +24,21 @@ export interface File {
     scope: Scope;
 }
 
+const execAsync = promisify(exec);
+
+// runs a shell command with its output going straight to ours, for programs whose output exec would have to buffer
+function spawnAsync(command: string, options: {cwd: string, env: NodeJS.ProcessEnv}): Promise<void> {
+    return new Promise((resolve, reject) => {
+        let child = spawn(command, {...options, shell: true, stdio: 'inherit'});
+        child.on('error', reject);
+        child.on('exit', (code, signal) => code === 0 ? resolve() : reject(new Error(`Command failed: ${command} (${signal ?? 'exit code ' + code})`)));
+    });
+}
+
+// a union argument is specialized for one type once the training run saw it at least this often and this much of the time
+const PGO_MIN_SAMPLES = 100;
+const PGO_MIN_RATIO = 0.9;
+
 export let nextIDNum = 0;
 
 export function getID(num?: number): string {
@@ -37,14 +54,107 @@ export class Compiler {
     config: Config;
     cache: Map<string, File> = new Map();
     unionFuncCalls: UnionFuncCall[] = [];
+    atoms: Map<string, number> = new Map();
+    structNames: Map<t.Object, string> = new Map();
+    structSignatures: Map<string, string> = new Map();
+    // the declarations (for shared.h) and definitions (for shared.c) of every struct, by name
+    structs: {name: string, decl: string, def: string}[] = [];
+    nextStructID: number = 0;
+    // structs and packed array kinds that are dynamic objects and any[]s instead, see Generator.escape
+    escapedTypes: Set<string> = new Set();
+    escapesChanged: boolean = false;
     builtinPath: string;
+    builtinHeaderPath: string;
     sharedPath: string;
+    sharedHeaderPath: string;
+    buildCache: BuildCache | null = null;
+    // see Compiler.record
+    recorders: SharedUsage[] = [];
+    // see Compiler.exec
+    running: number = 0;
+    waiting: (() => void)[] = [];
+    objects: Map<string, Promise<void>> = new Map();
+    // generate instruments union function call sites, use specializes them from typeProfile
+    profileMode: 'generate' | 'use' | null = null;
+    // site name to tag counts per argument
+    typeProfile: Map<string, number[][]> = new Map();
 
     constructor(config?: Config) {
         this.config = config ?? loadConfig();
         // @ts-ignore
         this.builtinPath = join(import.meta.dirname, '../internal/index.c');
+        this.builtinHeaderPath = changeExtension(this.builtinPath, '.h');
         this.sharedPath = join(this.config.rootDir, 'shared.c');
+        this.sharedHeaderPath = changeExtension(this.sharedPath, '.h');
+        if (this.config.cache) {
+            let {files, ...config} = this.config;
+            this.buildCache = new BuildCache(this.config.cacheDir, config);
+            for (let struct of this.buildCache.structs) {
+                this.structSignatures.set(struct.signature, struct.name);
+                this.structs.push({name: struct.name, decl: struct.decl, def: struct.def});
+                this.nextStructID = Math.max(this.nextStructID, parseInt(struct.name.slice('struct_'.length), 36) + 1);
+                this.replay(deserializeUsage(struct.usage));
+            }
+            this.buildCache.escapes.forEach(name => this.escapedTypes.add(name));
+            this.nextStructID = Math.max(this.nextStructID, this.buildCache.nextStructID);
+        }
+    }
+
+    addAtom(name: string): void {
+        if (!this.atoms.has(name)) {
+            this.atoms.set(name, this.atoms.size + 1);
+        }
+        this.recorders.forEach(usage => usage.atoms.add(name));
+    }
+
+    // returns the equal call that is already in shared.c if there is one
+    addUnionFuncCall(newCall: UnionFuncCall): UnionFuncCall {
+        let out = this.unionFuncCalls.find(call => unionFuncCallsAreEqual(call, newCall));
+        if (!out) {
+            out = newCall;
+            this.unionFuncCalls.push(out);
+        }
+        this.recorders.forEach(usage => usage.unionFuncCalls.push(out));
+        return out;
+    }
+
+    addStruct(signature: string, name: string, decl: string, def: string, usage: SharedUsage): void {
+        this.structSignatures.set(signature, name);
+        this.structs.push({name, decl, def});
+        this.buildCache?.structs.push({signature, name, decl, def, usage: serializeUsage(usage)});
+    }
+
+    // collects the atoms and union functions used while func runs, so they can be put back when its output comes from the cache
+    record<T>(func: () => T): [T, SharedUsage] {
+        let usage: SharedUsage = {atoms: new Set(), unionFuncCalls: [], escapes: new Set()};
+        this.recorders.push(usage);
+        try {
+            return [func(), usage];
+        } finally {
+            this.recorders.pop();
+        }
+    }
+
+    replay(usage: SharedUsage): void {
+        usage.atoms.forEach(name => this.addAtom(name));
+        usage.unionFuncCalls.forEach(call => this.addUnionFuncCall(call));
+        usage.escapes.forEach(name => this.escapeType(name));
+    }
+
+    escapeType(name: string): void {
+        if (!this.escapedTypes.has(name)) {
+            this.escapedTypes.add(name);
+            this.escapesChanged = true;
+            this.buildCache?.escapes.push(name);
+        }
+        this.recorders.forEach(usage => usage.escapes.add(name));
+    }
+
+    // leaves the file alone if it wouldn't change, so its modification time stays meaningful
+    writeFile(path: string, data: string): void {
+        if (!fs.existsSync(path) || fs.readFileSync(path).toString() !== data) {
+            fs.writeFileSync(path, data);
+        }
     }
 
     getAbsPath(path: string): string {
@@ -138,6 +248,14 @@ export class Compiler {
             throw new CompilerError('TypeError', `Unrecognized file type: ${path}`, null);
         }
         let code = fs.readFileSync(this.getAbsPath(path)).toString();
+        if (type === 'application/json') {
+            // folded here, so the module is its value as one literal and nothing is parsed at run time
+            try {
+                code = 'export default ' + JSON.stringify(JSON.parse(code)) + ';\n';
+            } catch (error) {
+                throw new CompilerError('SyntaxError', `Invalid JSON in ${path}: ${error instanceof Error ? error.message : error}`, null);
+            }
+        }
         let ast = this.parse(code, path, type);
         let scope = new Scope();
         let inferrer = new Inferrer(this, path, code, scope);
@@ -177,90 +295,295 @@ export class Compiler {
         return this.getFile(resolve(path));
     }
 
-    transform(file: File): string {
+    // a module's generated code only depends on its own source, the ids and export types of what it imports and which structs have escaped
+    getModuleKey(file: File): string {
+        return this.buildCache!.moduleKey(file.code, file.id, file.dependsOn.map(dep => [dep.path, dep.id, Array.from(dep.exports).map(([name, [type, cName]]) => `${name}: ${type} = ${cName}`).join('; ')]), Array.from(this.escapedTypes).sort());
+    }
+
+    // where the generated files for a source file go, without an extension
+    getOutputPath(path: string): string {
+        return this.config.outDir + this.getAbsPath(path).slice(this.config.rootDir.length);
+    }
+
+    // returns the module's code and header
+    transform(file: File): [string, string] {
+        let key = this.buildCache ? this.getModuleKey(file) : null;
+        if (key) {
+            let entry = this.buildCache!.getModule(file.path, key);
+            // another build sharing the cache may have pruned a struct the module uses
+            if (entry && (entry.code + entry.header).match(STRUCT_NAME)?.every(name => this.structs.some(struct => struct.name === name)) !== false) {
+                this.replay(deserializeUsage(entry.usage));
+                return [entry.code, entry.header];
+            }
+        }
         let gen = new Generator(this, file.id, file.path, file.code);
         gen.infer.getImportType = this.getImportTypeGetter(file.path);
         gen.getImportData = (path: string) => {
             path = this.getImportPath(path, file.path);
             let file_ = this.loadFile(path);
-            return [path, file_.id, file_.scope];
+            return [this.getOutputPath(path), file_.id, file_.scope];
         };
-        return gen.program(file.ast);
+        let [[code, header], usage] = this.record(() => [gen.program(file.ast), gen.header()]);
+        if (key) {
+            this.buildCache!.setModule(file.path, {key, code, header, usage: serializeUsage(usage)});
+        }
+        return [code, header];
     }
 
-    _transformAll(file: File, ids: Set<string>, usedIds: Set<string> = new Set()): Set<string> {
+    // each module becomes its own translation unit, other modules only see its header
+    _transformAll(file: File, ids: Set<string>, outputs: Map<string, string>, usedIds: Set<string> = new Set()): Set<string> {
         if (ids.has(file.id)) {
             return usedIds;
         }
-        let path = this.getAbsPath(file.path);
-        let code = this.transform(file);
-        if (this.config.outDir) {
-            path = this.config.outDir + path.slice(this.config.rootDir.length);
-        }
-        fs.writeFileSync(path + '.c', `\n$ifndef NEUTRINO_FILE_${file.id}\n#define NEUTRINO_FILE_${file.id}\n\n#include "${this.builtinPath}"\n#include "${this.sharedPath}"\n${code.slice(1)}\n#endif\n\n`);
+        let path = this.getOutputPath(file.path);
+        let [code, header] = this.transform(file);
+        let includes = `#include "${this.builtinHeaderPath}"\n#include "${this.sharedHeaderPath}"\n`;
+        outputs.set(path + '.h', `\n#ifndef NEUTRINO_FILE_${file.id}\n#define NEUTRINO_FILE_${file.id}\n\n${includes}\n${header}\n#endif\n`);
+        outputs.set(path + '.c', `\n${includes}#include "${path}.h"\n${code}`);
         usedIds.add(file.id);
         for (let dep of file.dependsOn) {
-            this._transformAll(dep, ids, usedIds);
+            this._transformAll(dep, ids, outputs, usedIds);
         }
         ids.add(file.id);
         return usedIds;
     }
 
-    transformAll(): void {
-        let ids: Set<string> = new Set();
-        for (let path of this.config.files) {
-            let file = this.loadFile(path);
-            let usedIds = this._transformAll(file, ids);
-            path = this.getAbsPath(path);
-            let code = fs.readFileSync(path + '.c').toString();
-            let body = '    init(argc, argv);\n' + Array.from(usedIds).map(id => `    main_${id}();`).join('\n');
-            fs.writeFileSync(path + '.c', code + `\n\nint main(int argc, char** argv) {\n${body}\n}\n`);
+    writeShared(): void {
+        let out = '\n#ifndef NEUTRINO_SHARED\n#define NEUTRINO_SHARED\n\n';
+        out += `#include "${this.builtinHeaderPath}"\n\n`;
+        for (let [name, id] of this.atoms) {
+            out += `#define ATOM_${name} ${id}\n`;
         }
+        out += `\n#define COMPILED_ATOM_COUNT ${this.atoms.size}\nextern char* compiled_atoms[];\n\n`;
+        if (this.structs.length > 0) {
+            out += this.structs.map(struct => struct.decl).join('') + '\n\n';
+        }
+        out += this.unionFuncCalls.map(call => createUnionFunc(call, this.config.nanBoxing) + '\n').join('');
+        this.writeFile(this.sharedHeaderPath, out + '#endif\n');
+        out = `\n#include "${this.builtinHeaderPath}"\n#include "${this.sharedHeaderPath}"\n\n`;
+        out += `char* compiled_atoms[] = {${Array.from(this.atoms.keys()).map(name => '"' + name + '"').join(', ')}};\n\n`;
+        if (this.structs.length > 0) {
+            out += this.structs.map(struct => struct.def).join('\n\n') + '\n';
+        }
+        this.writeFile(this.sharedPath, out);
     }
 
-    _compilePath(path: string, link: boolean = false, deps: string[] = []): void {
-        path = resolve(this.config.rootDir, path);
-        let options = '';
-        if (link && deps.length > 0) {
-            options += deps.map(path => path + '.o').join(' ') + ' ';
+    // whether a struct escapes is only known once every module using it is generated, so this regenerates everything until no new one does
+    transformAll(): void {
+        let outputs: Map<string, string> = new Map();
+        do {
+            this.escapesChanged = false;
+            this.structNames = new Map();
+            let ids: Set<string> = new Set();
+            outputs = new Map();
+            for (let path of this.config.files) {
+                let file = this.loadFile(path);
+                let usedIds = this._transformAll(file, ids, outputs);
+                path = this.getOutputPath(file.path) + '.c';
+                let prototypes = Array.from(usedIds).map(id => `void main_${id}();\n`).join('');
+                let body = '    gc_init();\n    init_atoms(compiled_atoms, COMPILED_ATOM_COUNT);\n    init(argc, argv);\n' + Array.from(usedIds).map(id => `    main_${id}();`).join('\n');
+                outputs.set(path, outputs.get(path) + `\n${prototypes}\nint main(int argc, char** argv) {\n${body}\n}\n`);
+            }
+        } while (this.escapesChanged);
+        if (this.buildCache) {
+            this.buildCache.nextStructID = this.nextStructID;
+            this.buildCache.pruneStructs(Array.from(outputs.values()));
+            let kept = new Set(this.buildCache.structs.map(struct => struct.name));
+            this.structs = this.structs.filter(struct => kept.has(struct.name));
+        }
+        for (let [path, code] of outputs) {
+            this.writeFile(path, code);
         }
-        options += path;
-        if (link) {
-            options += ' -o ' + changeExtension(path, '');
+        this.writeShared();
+    }
+
+    // runs a command once fewer than config.jobs are running, a finished job hands its slot straight to the next one waiting
+    async exec(command: string): Promise<void> {
+        if (this.running < this.config.jobs) {
+            this.running++;
         } else {
-            options += ' -c -o ' + path.slice(0, -2) + '.o';
+            await new Promise<void>(resolve => this.waiting.push(resolve));
+        }
+        try {
+            await execAsync(command);
+        } finally {
+            let next = this.waiting.shift();
+            if (next) {
+                next();
+            } else {
+                this.running--;
+            }
+        }
+    }
+
+    getAllDependancies(file: File, out: Set<string> = new Set()): string[] {
+        for (let dep of file.dependsOn) {
+            if (!out.has(dep.path)) {
+                out.add(dep.path);
+                this.getAllDependancies(dep, out);
+            }
         }
+        return Array.from(out);
+    }
+
+    getCompileCommand(options: string): string {
+        let out = `${this.config.cc} ${this.config.cflags} ${options}`;
         if (this.config.optimization > 0) {
-            options += ' -O' + this.config.optimization;
+            out += ' -O' + this.config.optimization;
         }
-        execSync(`${this.config.cc} ${this.config.cflags} ${options} ${this.config.ldflags}`);
+        return out;
     }
 
-    getAllDependancies(file: File): string[] {
-        return file.dependsOn.map(file => file.path).concat(...file.dependsOn.map(file => this.getAllDependancies(file)));
+    // what an output is recorded under in builds.json, the runtime headers every object includes change with the compiler's version
+    commandKey(command: string): string {
+        return hash(VERSION, command);
+    }
+
+    // with the cache on, an object built by the same command and newer than everything it includes is reused
+    // generated files are only rewritten when they change, so their times can be trusted
+    isUpToDate(output: string, command: string, inputs: string[]): boolean {
+        if (!this.buildCache || !this.buildCache.isBuilt(output, this.commandKey(command))) {
+            return false;
+        }
+        let time = fs.statSync(output).mtimeMs;
+        return inputs.every(path => !fs.existsSync(path) || fs.statSync(path).mtimeMs < time);
+    }
+
+    // each translation unit is compiled once no matter how many programs link it
+    compileObject(source: string, output: string, inputs: string[]): Promise<void> {
+        let out = this.objects.get(source);
+        if (!out) {
+            let command = this.getCompileCommand(`-c ${source} -o ${output}`);
+            if (this.isUpToDate(output, command, [source, ...inputs])) {
+                out = Promise.resolve();
+            } else {
+                out = this.exec(command).then(() => this.buildCache?.setBuilt(output, this.commandKey(command)));
+            }
+            this.objects.set(source, out);
+        }
+        return out;
+    }
 
+    // the whole program as one translation unit, so the C compiler can inline across modules and into the runtime
+    // -fwhole-program makes everything but main static
+    async compileUnity(file: File): Promise<void> {
+        let modules = [...this.getAllDependancies(file).reverse(), file.path].map(path => this.getOutputPath(path));
+        let sources = [this.builtinPath, this.sharedPath, ...modules.map(path => path + '.c')];
+        let path = this.getOutputPath(file.path) + '.unity.c';
+        this.writeFile(path, '\n' + sources.map(path => `#include "${path}"\n`).join(''));
+        let output = changeExtension(this.getOutputPath(file.path) + '.c', '');
+        let command = this.getCompileCommand(`-flto -fwhole-program ${path} -o ${output} ${this.config.ldflags}`);
+        let inputs = [path, ...sources, this.builtinHeaderPath, this.sharedHeaderPath, ...modules.map(path => path + '.h')];
+        if (this.isUpToDate(output, command, inputs)) {
+            return;
+        }
+        await this.exec(command);
+        this.buildCache?.setBuilt(output, this.commandKey(command));
     }
 
-    compilePath(path: string, link: boolean = true): void {
+    async compilePath(path: string, link: boolean = true): Promise<void> {
         let file = this.loadFile(path);
-        file.dependsOn.forEach(file => this._compilePath(path, false));
-        this._compilePath(file.path + '.c', link, this.getAllDependancies(file));
+        if (this.config.buildMode === 'unity' && link) {
+            return this.compileUnity(file);
+        }
+        let modules = [file.path, ...this.getAllDependancies(file)].map(path => this.getOutputPath(path));
+        let headers = modules.map(path => path + '.h');
+        let runtime = join(this.config.outDir, 'neutrino_runtime.o');
+        // every object is independent, linking waits for all of them
+        let objects = modules.map(path => path + '.o').concat(changeExtension(this.sharedPath, '.o'), runtime);
+        await Promise.all([
+            ...modules.map(path => this.compileObject(path + '.c', path + '.o', [this.builtinHeaderPath, this.sharedHeaderPath, ...headers])),
+            this.compileObject(this.sharedPath, changeExtension(this.sharedPath, '.o'), [this.builtinHeaderPath, this.sharedHeaderPath]),
+            this.compileObject(this.builtinPath, runtime, [this.builtinHeaderPath]),
+        ]);
+        if (!link) {
+            return;
+        }
+        let output = changeExtension(modules[0] + '.c', '');
+        let key: string | null = null;
+        if (this.buildCache) {
+            key = hash(this.commandKey(this.getCompileCommand(this.config.ldflags)), ...objects.map(path => fs.existsSync(path) ? String(fs.statSync(path).mtimeMs) : ''));
+            if (this.buildCache.isBuilt(output, key)) {
+                return;
+            }
+        }
+        await this.exec(this.getCompileCommand(`${objects.join(' ')} -o ${output} ${this.config.ldflags}`));
+        if (key) {
+            this.buildCache!.setBuilt(output, key);
+        }
+    }
+
+    async compileAll(): Promise<void> {
+        await Promise.all(this.config.files.map(path => this.compilePath(path)));
+    }
+
+    loadTypeProfile(path: string): void {
+        if (!fs.existsSync(path)) {
+            return;
+        }
+        for (let line of fs.readFileSync(path).toString().split('\n')) {
+            let [name, arg, ...counts] = line.split(' ');
+            if (counts.length === 0) {
+                continue;
+            }
+            let site = this.typeProfile.get(name) ?? [];
+            site[Number(arg)] = counts.map((count, i) => Number(count) + (site[Number(arg)]?.[i] ?? 0));
+            this.typeProfile.set(name, site);
+        }
     }
 
-    compileAll(): void {
-        for (let path of this.config.files) {
-            this.compilePath(path);
+    getHotTypes(site: string, call: UnionFuncCall): (UnionType | null)[] | undefined {
+        let counts = this.typeProfile.get(site);
+        if (!counts) {
+            return undefined;
         }
+        let out = call.args.map((arg, i): UnionType | null => {
+            if (!(arg instanceof Set) || !counts[i]) {
+                return null;
+            }
+            let total = counts[i].reduce((x, y) => x + y, 0);
+            let max = Math.max(...counts[i]);
+            let type = TAGGED_TYPES[counts[i].indexOf(max) - 1];
+            return total >= PGO_MIN_SAMPLES && max >= total * PGO_MIN_RATIO && arg.has(type) ? type : null;
+        });
+        return out.some(type => type) ? out : undefined;
     }
 
-    run(): void {
+    // builds an instrumented copy of every program, trains it with config.pgoCommand (by default each program with no arguments), then builds again using gcc's profile and the type profile
+    async runPGO(): Promise<void> {
+        let dir = join(this.config.cacheDir, 'pgo');
+        fs.rmSync(dir, {recursive: true, force: true});
+        fs.mkdirSync(dir, {recursive: true});
+        let typeProfile = join(dir, 'types.profile');
+        let flags = ` -DNEUTRINO_PROFILE -fprofile-generate=${dir}`;
+        let instrumented = new Compiler({...this.config, pgo: false, cache: false, cflags: this.config.cflags + flags, ldflags: this.config.ldflags + flags});
+        instrumented.profileMode = 'generate';
+        await instrumented.run();
+        let commands = this.config.pgoCommand ? [this.config.pgoCommand] : this.config.files.map(path => changeExtension(this.getOutputPath(resolve(path)) + '.c', ''));
+        for (let command of commands) {
+            await spawnAsync(command, {cwd: this.config.rootDir, env: {...process.env, NEUTRINO_PROFILE_OUT: typeProfile}});
+        }
+        this.loadTypeProfile(typeProfile);
+        this.profileMode = 'use';
+        // specialized sites change the code of the functions they are in, gcc drops the profile of just those functions
+        this.config = {...this.config, cflags: this.config.cflags + ` -fprofile-use=${dir} -fprofile-partial-training -Wno-missing-profile -Wno-coverage-mismatch`};
+        this.buildCache = null;
+        this.transformAll();
+        await this.compileAll();
+    }
+
+    async run(): Promise<void> {
+        if (this.config.pgo) {
+            return this.runPGO();
+        }
         this.transformAll();
-        this.compileAll();
+        await this.compileAll();
+        this.buildCache?.save();
     }
 
 }
 
 
-export function compile(config?: Config): void {
-    (new Compiler(config)).run();
+export function compile(config?: Config): Promise<void> {
+    return (new Compiler(config)).run();
 }
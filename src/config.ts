@@ -2,6 +2,7 @@
 import {join, resolve} from 'node:path';
 import {createRequire} from 'node:module';
 import * as fs from 'node:fs';
+import {availableParallelism} from 'node:os';
 import {CompilerError} from './util.js';
 
 
@@ -17,6 +18,14 @@ export interface Config {
     useDefaultCflags: boolean;
     useDefaultLdflags: boolean;
     optimization: number;
+    nanBoxing: boolean;
+    generationalGC: boolean;
+    cache: boolean;
+    cacheDir: string;
+    jobs: number;
+    buildMode: 'separate' | 'unity';
+    pgo: boolean;
+    pgoCommand: string;
 }
 
 
@@ -66,7 +75,7 @@ const isString = (x: unknown): x is string => typeof x === 'string';
 const isNumber = (x: unknown): x is number => typeof x === 'number';
 const resolveRootDir = (value: string) => resolve(rootDir, value);
 
-function validate(value: unknown): Config {
+export function validate(value: unknown): Config {
     if (!value || typeof value !== 'object') {
         error(`Expected object, got ${value}`);
     }
@@ -87,6 +96,20 @@ function validate(value: unknown): Config {
         value.ldflags = LDFLAGS + ' ' + value.ldflags;
     }
     validateKey(value, 'optimization', isNumber, 3);
+    validateKey(value, 'nanBoxing', isBoolean, false);
+    if (value.nanBoxing) {
+        value.cflags += ' -DNEUTRINO_NAN_BOXING';
+    }
+    validateKey(value, 'generationalGC', isBoolean, false);
+    if (value.generationalGC) {
+        value.cflags += ' -DNEUTRINO_GENERATIONAL_GC';
+    }
+    validateKey(value, 'cache', isBoolean, true);
+    validateKey(value, 'cacheDir', isString, join(value.rootDir, '.neutrino-cache'), resolveRootDir);
+    validateKey(value, 'jobs', isNumber, availableParallelism(), (x: number) => Math.max(1, Math.floor(x)));
+    validateKey(value, 'pgo', isBoolean, false);
+    validateKey(value, 'pgoCommand', isString, '');
+    validateKey(value, 'buildMode', (x: unknown): x is 'separate' | 'unity' => x === 'separate' || x === 'unity', 'separate', undefined, '"separate" or "unity"');
     return value;
 }
 
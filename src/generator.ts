@@ -1,21 +1,317 @@
 
 import type * as b from '@babel/types';
 import {t, Type, SimpleType, Stack, Scope, ASTManipulator} from './util.js';
-import {Inferrer} from './inferrer.js';
-import {UnionType, UnionFunc, UnionFuncCall, unionFuncCallsAreEqual, getCUnionFuncName} from './unions.js';
+import {Inferrer, IntegerRange} from './inferrer.js';
+import {UnionType, UnionFunc, UnionFuncCall, getCUnionFuncName, getDispatchType, createProfiledUnionFunc} from './unions.js';
 import type {Compiler} from './compiler.js';
 
 
 export type CTypeName = UnionType | 'unknown';
 
+const NON_STRUCT_TYPES = ['union', 'intersection', 'generic', 'typevar', 'infer', 'conditional'];
+
+// array methods the packed element kinds implement themselves, everything else gets a boxed copy
+const PACKED_ARRAY_METHODS = ['array_push', 'array_pop', 'array_shift', 'array_unshift'];
+
+// the array methods that change their array in place, a packed array they are called on gets their changes copied back
+const MUTATING_ARRAY_METHODS = ['array_sort', 'array_reverse', 'array_fill', 'array_copyWithin', 'array_splice'];
+
+// array methods with a callback that are expanded into a loop when it is a literal, see Generator.fusedArrayLoop
+const FUSED_ARRAY_METHODS = ['map', 'filter', 'forEach', 'reduce', 'every', 'some', 'findIndex'];
+
+// the typed arrays whose elements are numbers, the bigint ones only get the bulk methods
+const NUMBER_TYPED_ARRAYS = ['int8array', 'uint8array', 'uint8clampedarray', 'int16array', 'uint16array', 'int32array', 'uint32array', 'float32array', 'float64array'];
+const TYPED_ARRAYS = [...NUMBER_TYPED_ARRAYS, 'bigint64array', 'biguint64array'];
+
+// the tags of the values JSON.parse can make that aren't objects or arrays
+const JSON_TAGS: {[key: string]: string} = {undefined: 'UNDEFINED_TAG', null: 'NULL_TAG', boolean: 'BOOLEAN_TAG', number: 'NUMBER_TAG', string: 'STRING_TAG'};
+
+const FUNCTION_TYPES = ['FunctionDeclaration', 'FunctionExpression', 'ArrowFunctionExpression', 'ObjectMethod', 'ClassMethod', 'ClassPrivateMethod'];
+
+// calls visit on the nodes in a function body, stopping at anything visit returns false for
+function walk(node: any, visit: (node: any, parent: any) => boolean | void, parent: any = null): void {
+    if (!node || typeof node.type !== 'string' || visit(node, parent) === false) {
+        return;
+    }
+    for (let key in node) {
+        if (key === 'loc' || key === 'leadingComments' || key === 'trailingComments' || key === 'typeAnnotation' || key === 'returnType' || key === 'typeParameters') {
+            continue;
+        }
+        let value = node[key];
+        if (Array.isArray(value)) {
+            value.forEach(x => walk(x, visit, node));
+        } else if (value && typeof value === 'object') {
+            walk(value, visit, node);
+        }
+    }
+}
+
+// the variables a function declares itself, function declarations are kept apart (see functionDeclarations)
+function declaredNames(node: b.Function): Set<string> {
+    let out = new Set<string>();
+    for (let param of node.params) {
+        if (param.type === 'Identifier') {
+            out.add(param.name);
+        }
+    }
+    walk(node.body, node => {
+        if (FUNCTION_TYPES.includes(node.type)) {
+            return false;
+        } else if (node.type === 'VariableDeclarator' && node.id.type === 'Identifier') {
+            out.add(node.id.name);
+        } else if (node.type === 'ClassDeclaration' && node.id) {
+            out.add(node.id.name);
+        } else if (node.type === 'CatchClause' && node.param && node.param.type === 'Identifier') {
+            out.add(node.param.name);
+        }
+    });
+    return out;
+}
+
+// the variables of a function or program that are only ever declared with const, not counting the functions nested in it
+function constantNames(node: b.Function | b.Program): Set<string> {
+    let constants = new Set<string>();
+    let others = new Set<string>();
+    if (node.type !== 'Program') {
+        for (let param of node.params) {
+            if (param.type === 'Identifier') {
+                others.add(param.name);
+            }
+        }
+    }
+    let visit = (child: any): boolean => {
+        if (FUNCTION_TYPES.includes(child.type)) {
+            return false;
+        } else if (child.type === 'VariableDeclaration') {
+            for (let decl of child.declarations) {
+                if (decl.id.type === 'Identifier') {
+                    (child.kind === 'const' ? constants : others).add(decl.id.name);
+                }
+            }
+        } else if (child.type === 'CatchClause' && child.param && child.param.type === 'Identifier') {
+            others.add(child.param.name);
+        } else if (child.type === 'ClassDeclaration' && child.id) {
+            others.add(child.id.name);
+        }
+        return true;
+    };
+    for (let child of node.type === 'Program' ? node.body : [node.body]) {
+        walk(child, visit);
+    }
+    return new Set([...constants].filter(name => !others.has(name)));
+}
+
+function functionDeclarations(node: b.Function | b.Program): b.FunctionDeclaration[] {
+    let out: b.FunctionDeclaration[] = [];
+    let visit = (child: any): boolean => {
+        if (child.type === 'FunctionDeclaration' && child.id) {
+            out.push(child);
+        }
+        return !FUNCTION_TYPES.includes(child.type);
+    };
+    for (let child of node.type === 'Program' ? node.body : [node.body]) {
+        walk(child, visit);
+    }
+    return out;
+}
+
+function isReference(node: b.Identifier, parent: any): boolean {
+    if (!parent) {
+        return true;
+    } else if ((parent.type === 'MemberExpression' || parent.type === 'OptionalMemberExpression') && parent.property === node) {
+        return parent.computed;
+    } else if ((parent.type === 'ObjectProperty' || parent.type === 'ObjectMethod' || parent.type === 'ClassMethod' || parent.type === 'ClassProperty') && parent.key === node) {
+        return parent.computed || parent.shorthand;
+    } else {
+        return !['LabeledStatement', 'BreakStatement', 'ContinueStatement'].includes(parent.type);
+    }
+}
+
+// whether anything in node assigns one of the names or declares another variable with it
+function assignsAny(node: b.Node, names: string[]): boolean {
+    let out = false;
+    walk(node, child => {
+        let target: any = null;
+        if (child.type === 'AssignmentExpression') {
+            target = child.left;
+        } else if (child.type === 'UpdateExpression') {
+            target = child.argument;
+        } else if (child.type === 'VariableDeclarator' || child.type === 'ClassDeclaration') {
+            target = child.id;
+        } else if (child.type === 'CatchClause') {
+            target = child.param;
+        } else if (FUNCTION_TYPES.includes(child.type)) {
+            if ((child.id && names.includes(child.id.name)) || child.params.some((param: any) => param.type !== 'Identifier' || names.includes(param.name))) {
+                out = true;
+            }
+        }
+        if (target && target.type !== 'MemberExpression' && (target.type !== 'Identifier' || names.includes(target.name))) {
+            out = true;
+        }
+        return !out;
+    });
+    return out;
+}
+
+let freeNamesCache: WeakMap<b.Function, Set<string>> = new WeakMap();
+
+// the names a function uses from outside itself, including through the functions nested in it
+function freeNames(node: b.Function): Set<string> {
+    let cached = freeNamesCache.get(node);
+    if (cached) {
+        return cached;
+    }
+    let out = new Set<string>();
+    let declared = declaredNames(node);
+    for (let func of functionDeclarations(node)) {
+        declared.add(func.id!.name);
+    }
+    if (node.type === 'FunctionExpression' && node.id) {
+        declared.add(node.id.name);
+    }
+    walk(node.body, (child, parent) => {
+        if (FUNCTION_TYPES.includes(child.type)) {
+            for (let name of freeNames(child)) {
+                if (!declared.has(name)) {
+                    out.add(name);
+                }
+            }
+            return false;
+        } else if (child.type === 'Identifier' && isReference(child, parent) && !declared.has(child.name)) {
+            out.add(child.name);
+        }
+    });
+    freeNamesCache.set(node, out);
+    return out;
+}
+
+// the variables of a function that functions nested in it use, these live in its env instead of C locals
+function capturedNames(node: b.Function): Set<string> {
+    let declared = declaredNames(node);
+    let out = new Set<string>();
+    walk(node.body, child => {
+        if (FUNCTION_TYPES.includes(child.type)) {
+            for (let name of freeNames(child)) {
+                if (declared.has(name)) {
+                    out.add(name);
+                }
+            }
+            return false;
+        }
+    });
+    return out;
+}
+
+const LOOP_TYPES = ['ForStatement', 'ForInStatement', 'ForOfStatement', 'WhileStatement', 'DoWhileStatement'];
+
+// whether an expression changes nothing, so running it earlier or later than JS would can't be told apart
+function isPure(node: b.Node): boolean {
+    let out = true;
+    walk(node, child => {
+        if (['CallExpression', 'OptionalCallExpression', 'NewExpression', 'TaggedTemplateExpression', 'AssignmentExpression', 'UpdateExpression', 'AwaitExpression', 'YieldExpression'].includes(child.type) || (child.type === 'UnaryExpression' && child.operator === 'delete')) {
+            out = false;
+        }
+        return out;
+    });
+    return out;
+}
+
+// whether a function is a callback the array method it is passed to only calls while it runs
+function isSynchronousCallback(node: any, parent: any): boolean {
+    return parent && parent.type === 'CallExpression' && parent.arguments.includes(node) && parent.callee.type === 'MemberExpression' && !parent.callee.computed && parent.callee.property.type === 'Identifier' && FUSED_ARRAY_METHODS.includes(parent.callee.property.name);
+}
+
+// a let or const declared in a loop of node that a function made in the same loop uses, or null if there is none
+// callbacks of the array methods can't outlive the iteration, so only the functions made inside them count
+function loopCapturedName(node: b.Function | b.Program): string | null {
+    let out: string | null = null;
+    let visit = (child: any): boolean => {
+        if (out !== null || FUNCTION_TYPES.includes(child.type)) {
+            return false;
+        } else if (LOOP_TYPES.includes(child.type)) {
+            let names = new Set<string>();
+            walk(child, inner => {
+                if (FUNCTION_TYPES.includes(inner.type)) {
+                    return false;
+                } else if (inner.type === 'VariableDeclaration' && inner.kind !== 'var') {
+                    for (let decl of inner.declarations) {
+                        if (decl.id.type === 'Identifier') {
+                            names.add(decl.id.name);
+                        }
+                    }
+                }
+            });
+            walk(child, (inner, parent) => {
+                if (out !== null) {
+                    return false;
+                } else if (FUNCTION_TYPES.includes(inner.type) && !isSynchronousCallback(inner, parent)) {
+                    out = Array.from(freeNames(inner)).find(name => names.has(name)) ?? null;
+                    return false;
+                }
+            });
+        }
+        return out === null;
+    };
+    for (let child of node.type === 'Program' ? node.body : [node.body]) {
+        walk(child, visit);
+    }
+    return out;
+}
+
+// a function being generated
+interface Frame {
+    // names the env struct, env_<module id>_<index>
+    index: number;
+    declared: Set<string>;
+    captured: Set<string>;
+    // the declared names that are never assigned after their const declaration
+    constants: Set<string>;
+    // the C types of the captured variables, filled in as they are used
+    types: Map<string, Type>;
+    // the function declarations in it, by name
+    functions: Map<string, {name: string, node: b.FunctionDeclaration}>;
+    // the frames further out whose envs its own env keeps a pointer to
+    outers: Set<Frame>;
+    hasEnv: boolean;
+}
+
 
 export class Generator extends ASTManipulator {
 
-    static nextAnon: number = 0;
+    // per file, so a module's names don't depend on which other modules were generated this build
+    nextAnon: number = 0;
+    static nextTemp: number = 0;
 
     id: string;
     infer: Inferrer;
     importIncludes: string[] = [];
+    // the sites and wrappers of an instrumented build, see Generator.getUnionFunc
+    profileSites: string[] = [];
+    nextProfileSite: number = 0;
+    // one inline_cache per property read on an any, see Generator.inlineCache
+    inlineCaches: string[] = [];
+    // the functions being generated, innermost last, see Generator.function
+    frames: Frame[] = [];
+    nextFrame: number = 0;
+    // env structs, prototypes and closure records, they go before all of the functions
+    closureDecls: string[] = [];
+    // names bound by top level function declarations and imported functions, these are called directly
+    moduleFunctions: Set<string> = new Set();
+    importedFunctions: Set<string> = new Set();
+    // the top level variables that are only declared with const
+    moduleConstants: Set<string> = new Set();
+    // parameters of the callbacks being expanded by fusedArrayLoop, these are plain C locals
+    inlineParams: Set<string> = new Set();
+    // `array:index` for the loops whose bounds already keep array[index] in range, see Generator.boundedIndex
+    boundedIndexes: Set<string> = new Set();
+    // C temporaries that already hold the value of an expression, see the compound assignments in Generator.expression
+    evaluated: Map<b.Node, string> = new Map();
+    // the JSON decoders and writers made for each type so far, see Generator.jsonFunction
+    jsonFunctions: Map<string, string> = new Map();
+    // the trampolines made for each builtin signature so far, see Generator.closure
+    builtinClosures: Map<string, string> = new Map();
+    // struct functions go in shared.c, away from the module's profile sites
+    inStruct: boolean = false;
     functions: string[] = [];
     topLevel: string = '';
     thisArgs: Stack<string>;
@@ -38,21 +334,30 @@ export class Generator extends ASTManipulator {
 
     string(value: string): string {
         // @ts-ignore
-        return '"' + value.replaceAll('"', '\\"').replaceAll('\n', '\\n') + '"';
+        return 'STRING_LITERAL("' + value.replaceAll('"', '\\"').replaceAll('\n', '\\n') + '")';
+    }
+
+    atom(name: string): string {
+        if (!/^[A-Za-z_$][A-Za-z0-9_$]*$/.test(name)) {
+            return `intern(${this.string(name)})`;
+        }
+        this.compiler.addAtom(name);
+        return 'ATOM_' + name;
     }
 
     property(prop: b.Expression | b.PrivateName): [string, t.Type] {
         if (prop.type === 'Identifier') {
-            return [this.string(prop.name), t.string];
+            // atoms and symbols share one key space, so identifier keys go through the symbol variants
+            return [this.atom(prop.name), t.symbol];
         }
         let type = this.infer.expression(prop);
         let out = this.expression(prop);
         switch (type.type) {
             case 'undefined':
             case 'null':
-                return [`(${out}, "${type.type}")`, t.string];
+                return [`(${out}, ${this.string(type.type)})`, t.string];
             case 'boolean':
-                return [`(${out} ? "true" : "false")`, t.string];
+                return [`(${out} ? ${this.string('true')} : ${this.string('false')})`, t.string];
             case 'number':
                 return [`number_to_string(${out}, 10)`, t.string];
             case 'string':
@@ -72,37 +377,26 @@ export class Generator extends ASTManipulator {
         let out: string;
         if (type.type === 'object') {
             if (type.call) {
-                if (type.call.realVoid) {
-                    out = 'void ';
-                } else {
-                    out = this.type(type.call.returnType) + ' ';
+                // builtins are plain C functions, generated functions are passed around as closures
+                if (type.call.cName) {
+                    return this.signature(type.call, decl ? (name ?? '') : '(*' + (name ?? '') + ')', false) + (decl ? ';' : '');
                 }
-                out += (decl ? (name ?? '') : '(*' + (name ?? '') + ')') + '(';
-                if (!type.call.noThis) {
-                    out += 'object* this';
-                    if (type.call.params.length > 0) {
-                        out += ', ';
-                    }
-                }
-                if (type.call.params.length > 0) {
-                    out += type.call.params.map(param => this.type(param[1], param[0])).join(', ');
-                }
-                out += ')';
-                if (decl) {
-                    out += ';';
-                }
-                return out;
+                out = 'closure*';
             } else if (type.specialName) {
                 if (type.specialName === 'function' || type.specialName === 'symbolFunction') {
                     this.error('InternalError', 'Non-callable function type');
+                } else if (this.packedArrayKind(type)) {
+                    out = this.packedArrayKind(type) + '_array*';
                 } else {
                     out = type.specialName + '*';
                 }
+            } else if (this.isClosedObject(type)) {
+                out = this.struct(type) + '*';
             } else {
                 out = 'object*';
             }
         } else if (type.type === 'any' || type.type === 'unknown' || type.type === 'never') {
-            out = 'unknown*';
+            out = this.config.nanBoxing ? 'unknown' : 'unknown*';
         } else if (type.type === 'undefined' || type.type === 'null' || type.type === 'void') {
             out = 'void*';
         } else if (type.type === 'boolean' || type.type === 'boolean_value') {
@@ -110,11 +404,14 @@ export class Generator extends ASTManipulator {
         } else if (type.type === 'number' || type.type === 'number_value') {
             out = 'double';
         } else if (type.type === 'string' || type.type === 'string_value') {
-            out = 'latin1' in type ? 'char*' : 'full_string*';
+            // a pointer to the data of a full_string, see builtins/types.h
+            out = 'char*';
         } else if (type.type === 'symbol' || type.type === 'unique_symbol') {
             out = 'symbol';
         } else if (type.type === 'bigint' || type.type === 'bigint_value') {
             out = 'bigint';
+        } else if (type.type === 'union') {
+            out = 'unknown';
         } else {
             this.error('InternalError', `Invalid type in Generator.type of type ${type.type}`);
         }
@@ -127,6 +424,752 @@ export class Generator extends ASTManipulator {
         return out;
     }
 
+    // generated functions take the env of their closure first, see Generator.function
+    signature(call: t.CallData, name: string, env: boolean): string {
+        let params = call.params.map(param => this.type(param[1], param[0]));
+        if (!call.noThis) {
+            params.unshift('object* this');
+        }
+        if (env) {
+            params.unshift('void* closure_env');
+        }
+        return (call.realVoid ? 'void' : this.type(call.returnType)) + ' ' + name + '(' + params.join(', ') + ')';
+    }
+
+    isClosedObject(type: Type): type is t.Object {
+        if (type.type !== 'object' || !type.closed || type.specialName || type.call || type.construct || type.indexes.length > 0) {
+            return false;
+        }
+        let keys = Reflect.ownKeys(type.props);
+        // builtin functions are excluded since boxing them needs a trampoline from the module, and struct functions go in shared.c
+        if (keys.length === 0 || !keys.every(key => typeof key === 'string' && /^[A-Za-z_$][A-Za-z0-9_$]*$/.test(key) && !NON_STRUCT_TYPES.includes(type.props[key].type) && !(type.props[key].type === 'object' && (type.props[key] as t.Object).call?.cName))) {
+            return false;
+        }
+        return !this.compiler.escapedTypes.has(this.struct(type as t.Object));
+    }
+
+    // a struct can't be shared with an object, an any or a struct of another layout without copying it, which would break aliasing, so once a value of some struct flows into one the whole layout is made a dynamic object, see Compiler.transformAll
+    // packed arrays are the same with any[], once one of a kind flows into any every array of that kind is an any[]
+    escape(type: Type): void {
+        if (this.inStruct) {
+            return;
+        } else if (this.isClosedObject(type)) {
+            this.compiler.escapeType(this.struct(type));
+        } else if (this.packedArrayKind(type)) {
+            this.compiler.escapeType(this.packedArrayKind(type) + '_array');
+        }
+    }
+
+    // number[], string[] and boolean[] are stored unboxed and only boxed when they flow into any
+    packedArrayKind(type: Type): 'number' | 'string' | 'boolean' | null {
+        if (type.type !== 'object' || type.specialName !== 'array' || type.indexes.length !== 1) {
+            return null;
+        }
+        let elt = type.indexes[0].value.type;
+        let kind: 'number' | 'string' | 'boolean';
+        if (elt === 'number' || elt === 'number_value') {
+            kind = 'number';
+        } else if (elt === 'string' || elt === 'string_value') {
+            kind = 'string';
+        } else if (elt === 'boolean' || elt === 'boolean_value') {
+            kind = 'boolean';
+        } else {
+            return null;
+        }
+        return this.compiler.escapedTypes.has(kind + '_array') ? null : kind;
+    }
+
+    // methods declared on the typed arrays as typedarray_<name> are typed by the receiver, like the packed array ones
+    typedArrayKind(type: Type): string | null {
+        return type.type === 'object' && type.specialName && TYPED_ARRAYS.includes(type.specialName) ? type.specialName : null;
+    }
+
+    // the array[index] of a typed array that skips the bounds check, or null
+    boundedElement(node: b.MemberExpression | b.OptionalMemberExpression, kind: string): string | null {
+        if (!NUMBER_TYPED_ARRAYS.includes(kind) || node.object.type !== 'Identifier' || node.property.type !== 'Identifier' || !this.boundedIndexes.has(node.object.name + ':' + node.property.name)) {
+            return null;
+        }
+        return `${this.expression(node.object)}->data[${this.integerIndex(node.property) ?? '(uint32_t)' + this.expression(node.property)}]`;
+    }
+
+    // an array index that is an integer loop counter which is never negative, as a uint32_t
+    // 2 ** 32 - 1 is not an array index, the same as <kind>_is_index
+    integerIndex(node: b.Expression | b.PrivateName): string | null {
+        let range = node.type === 'Identifier' ? this.infer.integerVars.get(node.name) : undefined;
+        return range && range[0] >= 0 && range[1] < 2 ** 32 - 1 ? `(uint32_t)${this.identifier((node as b.Identifier).name)}` : null;
+    }
+
+    /*
+    for (let i = a; i < b; i++) and the other loops that count by a constant step towards b, where a and b have an integer range (see Inferrer.integerRange) and the body never assigns i or uses it in a function
+    i stays between a and b widened by one step, so it is a C int32_t, or an int64_t when that range doesn't fit, and can't overflow
+    */
+    integerLoop(node: b.ForStatement): {name: string, range: IntegerRange, cType: string} | null {
+        let {init, test, update} = node;
+        if (!init || init.type !== 'VariableDeclaration' || init.kind !== 'let' || init.declarations.length !== 1 || init.declarations[0].id.type !== 'Identifier' || !init.declarations[0].init) {
+            return null;
+        }
+        let name = init.declarations[0].id.name;
+        let start = this.infer.integerRange(init.declarations[0].init);
+        let step: number | null = null;
+        if (update && update.type === 'UpdateExpression' && update.argument.type === 'Identifier' && update.argument.name === name) {
+            step = update.operator === '++' ? 1 : -1;
+        } else if (update && update.type === 'AssignmentExpression' && (update.operator === '+=' || update.operator === '-=') && update.left.type === 'Identifier' && update.left.name === name && update.right.type === 'NumericLiteral' && Number.isInteger(update.right.value) && update.right.value > 0 && update.right.value <= 2 ** 31) {
+            step = update.operator === '+=' ? update.right.value : -update.right.value;
+        }
+        if (!start || step === null || !test || test.type !== 'BinaryExpression' || test.left.type !== 'Identifier' || test.left.name !== name) {
+            return null;
+        }
+        let bound = this.infer.integerRange(test.right);
+        if (!bound || this.inlineParams.has(name) || assignsAny(node.body, [name])) {
+            return null;
+        }
+        // the range includes the bound's so it can be compared to i in i's type
+        let range: IntegerRange;
+        if (step > 0 && (test.operator === '<' || test.operator === '<=')) {
+            range = [Math.min(start[0], bound[0]), Math.max(start[1], bound[1] + step - (test.operator === '<' ? 1 : 0))];
+        } else if (step < 0 && (test.operator === '>' || test.operator === '>=')) {
+            range = [Math.min(start[0], bound[0] + step + (test.operator === '>' ? 1 : 0)), Math.max(start[1], bound[1])];
+        } else {
+            return null;
+        }
+        let captured = false;
+        walk(node.body, child => {
+            if (FUNCTION_TYPES.includes(child.type)) {
+                captured ||= freeNames(child).has(name);
+                return false;
+            }
+        });
+        if (captured) {
+            return null;
+        }
+        let cType = range[0] >= -(2 ** 31) && range[1] < 2 ** 31 ? 'int32_t' : 'int64_t';
+        return {name, range, cType};
+    }
+
+    // the operand of a bitwise operator as an int32_t, or a uint32_t when unsigned, converting only what isn't already known to fit
+    bitwiseOperand(node: b.Expression | b.PrivateName, code: string, type: Type, unsigned: boolean = false): string {
+        let range = this.infer.integerRange(node);
+        if (range && range[0] >= -(2 ** 31) && range[1] < 2 ** 31) {
+            return unsigned ? `(uint32_t)(int32_t)${code}` : `(int32_t)${code}`;
+        } else if (range && unsigned && range[0] >= 0 && range[1] < 2 ** 32) {
+            return `(uint32_t)${code}`;
+        }
+        return `${unsigned ? 'to_uint32' : 'to_int32'}(${this.toNumber(code, type)})`;
+    }
+
+    // whether only the code of the innermost function can assign a variable: a const, or a local of that function which no function nested in it uses
+    // module variables are globals that other functions and modules can assign
+    isLocalBinding(name: string): boolean {
+        if (this.inlineParams.has(name)) {
+            return false;
+        }
+        let top = this.frames.length - 1;
+        for (let i = top; i >= 0; i--) {
+            let frame = this.frames[i];
+            if (frame.declared.has(name)) {
+                return frame.constants.has(name) || (i === top && !frame.captured.has(name));
+            } else if (frame.functions.has(name)) {
+                return false;
+            }
+        }
+        return this.moduleConstants.has(name);
+    }
+
+    /*
+    the `array:index` of for (let i = n; i < array.length; i++) where array is a typed array, n a non-negative integer and the body never assigns or rebinds either
+    array must be a const or a local no other function can assign (see Generator.isLocalBinding), since the body may call them
+    typed arrays can't change length, so array[i] in the body is always in range
+    */
+    boundedIndex(node: b.ForStatement): string | null {
+        let {init, test, update} = node;
+        if (!init || init.type !== 'VariableDeclaration' || init.declarations.length !== 1 || init.declarations[0].id.type !== 'Identifier') {
+            return null;
+        }
+        let index = init.declarations[0].id.name;
+        let start = init.declarations[0].init;
+        if (!start || start.type !== 'NumericLiteral' || start.value < 0 || !Number.isInteger(start.value)) {
+            return null;
+        }
+        if (!test || test.type !== 'BinaryExpression' || test.operator !== '<' || test.left.type !== 'Identifier' || test.left.name !== index) {
+            return null;
+        }
+        let bound = test.right;
+        if (bound.type !== 'MemberExpression' || bound.computed || bound.object.type !== 'Identifier' || bound.property.type !== 'Identifier' || bound.property.name !== 'length' || !this.typedArrayKind(this.infer.expression(bound.object))) {
+            return null;
+        }
+        let array = bound.object.name;
+        if (!this.isLocalBinding(array)) {
+            return null;
+        }
+        if (!update || !(
+            (update.type === 'UpdateExpression' && update.operator === '++' && update.argument.type === 'Identifier' && update.argument.name === index)
+            || (update.type === 'AssignmentExpression' && update.operator === '+=' && update.left.type === 'Identifier' && update.left.name === index && update.right.type === 'NumericLiteral' && update.right.value === 1)
+        )) {
+            return null;
+        }
+        return assignsAny(node.body, [index, array]) ? null : array + ':' + index;
+    }
+
+    isNumeric(node: b.Expression | b.PrivateName): boolean {
+        if (node.type === 'PrivateName') {
+            return false;
+        }
+        let type = this.infer.expression(node).type;
+        return type === 'number' || type === 'number_value';
+    }
+
+    packedArray(node: b.ArrayExpression, type: Type): string {
+        let kind = this.packedArrayKind(type);
+        if (node.elements.length === 0) {
+            return `create_${kind}_array(0)`;
+        }
+        return `create_${kind}_array_with_items(${node.elements.length}, ${this.packedArrayItems(node, kind!).join(', ')})`;
+    }
+
+    packedArrayItems(node: b.ArrayExpression, kind: 'number' | 'string' | 'boolean'): string[] {
+        let eltType = kind === 'number' ? t.number : (kind === 'string' ? t.string : t.boolean);
+        return node.elements.map(elt => {
+            if (!elt) {
+                return kind === 'number' ? 'NaN' : (kind === 'string' ? 'NULL' : 'false');
+            } else if (elt.type === 'SpreadElement') {
+                this.error('SyntaxError', 'Spread elements are not supported');
+            }
+            return this.to(eltType, this.expression(elt), this.simplify(this.infer.expression(elt)));
+        });
+    }
+
+    // an arrow or function expression that only returns an expression and has no functions, this or arguments in it
+    inlineCallback(node: b.Node | undefined, maxParams: number): {params: string[], body: b.Expression} | null {
+        if (!node || (node.type !== 'ArrowFunctionExpression' && node.type !== 'FunctionExpression') || node.async || node.generator || node.params.length > maxParams) {
+            return null;
+        }
+        let params: string[] = [];
+        for (let param of node.params) {
+            if (param.type !== 'Identifier') {
+                return null;
+            }
+            params.push(param.name);
+        }
+        let body: b.Expression;
+        if (node.body.type !== 'BlockStatement') {
+            body = node.body;
+        } else if (node.body.body.length === 1 && node.body.body[0].type === 'ReturnStatement' && node.body.body[0].argument) {
+            body = node.body.body[0].argument;
+        } else {
+            return null;
+        }
+        let simple = true;
+        walk(body, child => {
+            if (FUNCTION_TYPES.includes(child.type) || (child.type === 'ThisExpression' && node.type === 'FunctionExpression') || (child.type === 'Identifier' && child.name === 'arguments')) {
+                simple = false;
+            }
+            return simple;
+        });
+        return simple ? {params, body} : null;
+    }
+
+    /*
+    a chain of maps and filters over a packed array, ending in one of FUSED_ARRAY_METHODS, with callback literals becomes one loop
+    the callbacks are expanded in it, intermediate arrays are never built and the output array is reserved up front
+    returns null to leave the call to the runtime
+    */
+    fusedArrayLoop(node: b.CallExpression): string | null {
+        let stages: {method: string, params: string[], body: b.Expression, init: b.Expression | null}[] = [];
+        let source: b.Expression = node;
+        while (source.type === 'CallExpression' && source.callee.type === 'MemberExpression' && !source.callee.computed && source.callee.property.type === 'Identifier') {
+            let method = source.callee.property.name;
+            let args = source.arguments;
+            if (!FUSED_ARRAY_METHODS.includes(method) || (stages.length > 0 && method !== 'map' && method !== 'filter') || args.length !== (method === 'reduce' ? 2 : 1) || args[args.length - 1].type === 'SpreadElement') {
+                break;
+            }
+            let callback = this.inlineCallback(args[0], 2);
+            if (!callback) {
+                break;
+            }
+            stages.unshift({method, params: callback.params, body: callback.body, init: method === 'reduce' ? args[1] as b.Expression : null});
+            source = source.callee.object as b.Expression;
+        }
+        let kind = this.packedArrayKind(this.infer.expression(source));
+        if (stages.length === 0 || !kind) {
+            return null;
+        }
+        let eltType = (kind === 'number' ? t.number : (kind === 'string' ? t.string : t.boolean)) as SimpleType;
+        let last = stages[stages.length - 1];
+        // JS runs each stage over the whole array before the next, the loop runs them one item at a time
+        // that only looks the same when no stage, nor a reduce's initial value, changes anything the others or the source array hold
+        if (stages.length > 1 && !stages.every(stage => isPure(stage.body) && (!stage.init || isPure(stage.init)))) {
+            return null;
+        }
+        // infer every callback first, so nothing is generated for a chain that doesn't fit
+        let types: SimpleType[] = [];
+        let valueType = eltType;
+        let accType: SimpleType | null = last.init ? this.simplify(this.infer.expression(last.init)) : null;
+        for (let stage of stages) {
+            this.pushScope();
+            let [item, index] = stage.method === 'reduce' ? [stage.params[1], null] : stage.params;
+            if (stage.method === 'reduce' && stage.params[0]) {
+                this.scope.set(stage.params[0], accType!);
+            }
+            if (item) {
+                this.scope.set(item, valueType);
+            }
+            if (index) {
+                this.scope.set(index, t.number);
+            }
+            let type = this.simplify(this.infer.expression(stage.body));
+            types.push(type);
+            if (stage.method === 'map') {
+                valueType = type;
+            }
+        }
+        stages.forEach(() => this.popScope());
+        let resultType = this.infer.expression(node);
+        let outKind: 'number' | 'string' | 'boolean' | null = null;
+        if (last.method === 'map' || last.method === 'filter') {
+            outKind = this.packedArrayKind(t.array(valueType));
+            if (!outKind || this.packedArrayKind(resultType) !== outKind) {
+                return null;
+            }
+        } else if (last.method === 'reduce' && this.type(resultType) !== this.type(accType!)) {
+            return null;
+        }
+        let n = Generator.nextTemp++;
+        let src = `fused_src_${n}`;
+        let i = `fused_i_${n}`;
+        let length = `fused_length_${n}`;
+        // the output is reserved for the items there are now, callbacks that push to the source don't get to run longer
+        let before = [`${kind}_array* ${src} = ${this.expression(source)};`, `uint32_t ${length} = ${src}->length;`];
+        let loop: string[] = [];
+        let result: string;
+        if (outKind) {
+            result = `fused_out_${n}`;
+            before.push(`${outKind}_array* ${result} = create_${outKind}_array(0);`, `${outKind}_array_reserve(${result}, ${length});`);
+        } else if (last.method === 'reduce') {
+            result = `fused_acc_${n}`;
+            before.push(`${this.type(accType!, result)} = ${this.expression(last.init!)};`);
+        } else if (last.method === 'forEach') {
+            result = 'NULL';
+        } else {
+            result = `fused_result_${n}`;
+            before.push(last.method === 'findIndex' ? `double ${result} = -1;` : `bool ${result} = ${last.method === 'every'};`);
+        }
+        let value = `${src}->items[${i}]`;
+        valueType = eltType;
+        // each stage is a block in the one before it, so callbacks can reuse parameter names
+        for (let [k, stage] of stages.entries()) {
+            let emit = (code: string): void => {
+                loop.push(code.split('\n').map(line => '    '.repeat(k + 1) + line).join('\n'));
+            };
+            this.pushScope();
+            loop.push('    '.repeat(k) + '{');
+            let [item, index] = stage.method === 'reduce' ? [stage.params[1], null] : stage.params;
+            let bind = (name: string, type: SimpleType, value: string): string => {
+                this.scope.set(name, type);
+                this.inlineParams.add(name);
+                // a filter passes its parameter on as is, a later callback with the same parameter name just keeps using it
+                if (value !== this.identifier(name)) {
+                    emit(`${this.type(type, this.identifier(name))} = ${value};`);
+                }
+                return this.identifier(name);
+            };
+            if (stage.method === 'reduce' && stage.params[0]) {
+                bind(stage.params[0], accType!, result);
+            }
+            if (item) {
+                bind(item, valueType, value);
+            }
+            // the index of the item among the ones that reached this stage
+            let position: string | null = null;
+            if (index || stage.method === 'findIndex') {
+                let counter = `fused_index_${n}_${k}`;
+                before.push(`uint32_t ${counter} = 0;`);
+                if (index) {
+                    position = bind(index, t.number, `${counter}++`);
+                } else {
+                    position = `fused_position_${n}`;
+                    emit(`double ${position} = ${counter}++;`);
+                }
+            }
+            let body = this.expression(stage.body);
+            let type = types[k];
+            if (stage.method === 'map') {
+                value = `fused_value_${n}_${k}`;
+                valueType = type;
+                emit(`${this.type(type, value)} = ${body};`);
+            } else if (stage.method === 'filter') {
+                emit(`if (!(${this.toBoolean(body, type)})) {\n    continue;\n}`);
+            } else if (stage.method === 'forEach') {
+                emit(`${body};`);
+            } else if (stage.method === 'reduce') {
+                emit(`${result} = ${this.to(accType!, body, type)};`);
+            } else if (stage.method === 'findIndex') {
+                emit(`if (${this.toBoolean(body, type)}) {\n    ${result} = ${position};\n    break;\n}`);
+            } else {
+                let test = this.toBoolean(body, type);
+                emit(`if (${stage.method === 'every' ? `!(${test})` : test}) {\n    ${result} = ${stage.method === 'some'};\n    break;\n}`);
+            }
+            if (k === stages.length - 1 && outKind) {
+                let outType = (outKind === 'number' ? t.number : (outKind === 'string' ? t.string : t.boolean)) as SimpleType;
+                emit(`${result}->items[${result}->length++] = ${this.to(outType, value, valueType)};`);
+            }
+        }
+        for (let k = stages.length - 1; k >= 0; k--) {
+            this.popScope();
+            loop.push('    '.repeat(k) + '}');
+            for (let param of stages[k].params) {
+                this.inlineParams.delete(param);
+            }
+        }
+        let code = before.join('\n') + `\nfor (uint32_t ${i} = 0; ${i} < ${length} && ${i} < ${src}->length; ${i}++) {\n${this.indent(loop.join('\n'))}\n}\n${result};`;
+        return `({\n${this.indent(code)}\n})`;
+    }
+
+    struct(type: t.Object): string {
+        let name = this.compiler.structNames.get(type);
+        if (name) {
+            return name;
+        }
+        name = 'struct_' + (this.compiler.nextStructID++).toString(36);
+        this.compiler.structNames.set(type, name);
+        let keys = Object.keys(type.props);
+        let fields = keys.map(key => this.type(type.props[key], 'js_' + key));
+        let signature = fields.join('; ');
+        let existing = this.compiler.structSignatures.get(signature);
+        if (existing) {
+            this.compiler.structNames.set(type, existing);
+            return existing;
+        }
+        let params = fields.join(', ');
+        let decl = `typedef struct ${name} ${name};\n${name}* create_${name}(${params});\nobject* ${name}_to_object(${name}* value);\n`;
+        let out = `struct ${name} {\n${this.indent(fields.map(field => field + ';').join('\n'))}\n};\n\n`;
+        let pointers = keys.map(key => this.gcPointerOffset(name, key, type.props[key])).filter(x => x !== null);
+        let alloc: string;
+        if (pointers.length > 0) {
+            out += `GC_TYPE(${name}_gc_type, ${name}, ${pointers.join(', ')});\n\n`;
+            alloc = `gc_malloc_typed(&${name}_gc_type)`;
+        } else {
+            alloc = `malloc_atomic(sizeof(${name}))`;
+        }
+        out += `${name}* create_${name}(${params}) {\n    ${name}* out = ${alloc};\n${this.indent(keys.map(key => `out->js_${key} = js_${key};`).join('\n'))}\n    return out;\n}\n\n`;
+        let wasInStruct = this.inStruct;
+        this.inStruct = true;
+        let [toObject, usage] = this.compiler.record(() => `object* ${name}_to_object(${name}* value) {\n    return create_object(object_prototype, ${keys.length}, ${keys.map(key => this.atom(key) + ', ' + this.anyValue('value->js_' + key, type.props[key])).join(', ')});\n}`);
+        this.inStruct = wasInStruct;
+        this.compiler.addStruct(signature, name, decl, out + toObject, usage);
+        return name;
+    }
+
+    // the word of a struct field the collector has to scan, or null for fields that never hold a pointer
+    gcPointerOffset(struct: string, key: string, type: Type): string | null {
+        let ctype = this.type(type);
+        if (ctype === 'unknown') {
+            return `GC_UNKNOWN_OFFSET(${struct}, js_${key})`;
+        } else if ((ctype.endsWith('*') && !ctype.includes('(')) || ctype === 'bigint') {
+            return `offsetof(${struct}, js_${key})`;
+        } else {
+            return null;
+        }
+    }
+
+    anyValue(value: string, type: Type): string {
+        this.escape(type);
+        if (this.isClosedObject(type)) {
+            return `(any){.object = ${this.struct(type)}_to_object(${value})}`;
+        } else if (this.packedArrayKind(type)) {
+            return `(any){.array = cast_${this.packedArrayKind(type)}_array_to_any_array(${value})}`;
+        }
+        switch (type.type) {
+            case 'any':
+                return `unknown_to_any(${value})`;
+            case 'boolean':
+            case 'boolean_value':
+                return `(any){.boolean = ${value}}`;
+            case 'number':
+            case 'number_value':
+                return `(any){.number = ${value}}`;
+            case 'string':
+            case 'string_value':
+                return `(any){.string = (char*)${value}}`;
+            case 'symbol':
+            case 'unique_symbol':
+                return `(any){.symbol = ${value}}`;
+            case 'object':
+                if (type.call) {
+                    return `(any){.function = ${this.closure(value, type.call)}}`;
+                } else if (type.specialName === 'array' || type.specialName === 'proxy') {
+                    return `(any){.${type.specialName} = ${value}}`;
+                } else {
+                    return `(any){.object = (object*)${value}}`;
+                }
+            default:
+                return `(${value}, (any){.undefined = NULL})`;
+        }
+    }
+
+    fromAnyValue(value: string, type: Type): string {
+        this.escape(type);
+        if (this.isClosedObject(type)) {
+            return this.castObject(type, `${value}.object`, t.object());
+        } else if (this.packedArrayKind(type)) {
+            return `cast_any_array_to_${this.packedArrayKind(type)}_array(${value}.array)`;
+        }
+        switch (type.type) {
+            case 'boolean':
+            case 'boolean_value':
+                return `${value}.boolean`;
+            case 'number':
+            case 'number_value':
+                return `${value}.number`;
+            case 'string':
+            case 'string_value':
+                return `(${this.type(type)})${value}.string`;
+            case 'symbol':
+            case 'unique_symbol':
+                return `${value}.symbol`;
+            case 'undefined':
+            case 'null':
+                return `${value}.undefined`;
+            case 'object':
+                if (type.call) {
+                    if (type.call.cName) {
+                        this.error('TypeError', `Cannot read a builtin function of type ${type} from a dynamic object`);
+                    }
+                    return `${value}.function`;
+                } else if (type.specialName === 'array' || type.specialName === 'proxy') {
+                    return `${value}.${type.specialName}`;
+                } else {
+                    return `${value}.object`;
+                }
+            default:
+                this.error('TypeError', `Cannot read value of type ${type} from a dynamic object`);
+        }
+    }
+
+    castObject(newType: t.Object, value: string, type: t.Object): string {
+        if (!this.isClosedObject(newType) || !this.isClosedObject(type) || this.struct(newType) !== this.struct(type)) {
+            this.escape(newType);
+            this.escape(type);
+        }
+        let closed = this.isClosedObject(type);
+        if (this.isClosedObject(newType)) {
+            let name = this.struct(newType);
+            if (closed && this.struct(type) === name) {
+                return value;
+            }
+            let temp = 'cast_' + Generator.nextTemp++;
+            let keys = Object.keys(newType.props);
+            let fields = keys.map(key => closed ? `${temp}->js_${key}` : this.fromAnyValue(`get_object_atom(${temp}, ${this.atom(key)})`, newType.props[key]));
+            return `({${this.type(type)} ${temp} = ${value}; create_${name}(${fields.join(', ')});})`;
+        } else if (closed) {
+            return `${this.struct(type)}_to_object(${value})`;
+        } else {
+            return value;
+        }
+    }
+
+    // a function value as a closure*, builtins are plain C functions so they get a closure with the function as its env and a trampoline that calls it
+    closure(value: string, call: t.CallData): string {
+        if (!call.cName) {
+            return value;
+        }
+        let key = this.signature(call, '(*)', false);
+        let name = this.builtinClosures.get(key);
+        if (!name) {
+            name = `builtin_closure_${this.id}_${this.builtinClosures.size}`;
+            this.builtinClosures.set(key, name);
+            let args = (call.noThis ? [] : ['this']).concat(call.params.map(param => param[0])).join(', ');
+            let signature = this.signature(call, name, true);
+            this.closureDecls.push(`static ${signature};`);
+            this.functions.push(`static ${signature} {\n    ${call.realVoid ? '' : 'return '}((${key})closure_env)(${args});\n}`);
+        }
+        return `create_closure(${name}, (void*)${value})`;
+    }
+
+    // a static function made once per type and module, declared before it is filled in so recursive types can call it
+    jsonFunction(kind: 'read' | 'write', type: Type, body: (name: string) => [string, string]): string {
+        let key = kind + ' ' + String(type);
+        let name = this.jsonFunctions.get(key);
+        if (name) {
+            return name;
+        }
+        name = `json_${kind}_${this.id}_${this.jsonFunctions.size}`;
+        this.jsonFunctions.set(key, name);
+        let [signature, code] = body(name);
+        this.closureDecls.push(`static ${signature};`);
+        this.functions.push(`static ${signature} {\n${this.indent(code)}\n}`);
+        return name;
+    }
+
+    // C that reads a value of type from the json_parser* parser, failing on anything else, see builtins/core/json.h
+    jsonRead(type: Type, parser: string): string {
+        type = this.simplify(type);
+        switch (type.type) {
+            case 'number':
+            case 'number_value':
+                return `json_parse_number(${parser})`;
+            case 'string':
+            case 'string_value':
+                return `json_parse_string(${parser})`;
+            case 'boolean':
+            case 'boolean_value':
+                return `json_parse_boolean(${parser})`;
+            case 'null':
+                return `(json_parse_null(${parser}), NULL)`;
+            case 'any':
+                return `json_parse_value(${parser})`;
+            case 'union':
+                let tags = type.types.map(member => JSON_TAGS[member.type.replace('_value', '')]);
+                if (tags.some(tag => tag === undefined)) {
+                    break;
+                }
+                let temp = 'json_' + Generator.nextTemp++;
+                let test = tags.map(tag => `union_type(${temp}) != ${tag}`).join(' && ');
+                return `({unknown ${temp} = union_from_unknown(json_parse_value(${parser})); if (${test}) json_error(${parser}, "Expected ${String(type).replace(/["\\]/g, '\\$&')}"); ${temp};})`;
+            case 'object':
+                let kind = this.packedArrayKind(type);
+                if (this.isClosedObject(type)) {
+                    let struct = this.struct(type);
+                    let objType = type;
+                    return this.jsonFunction('read', type, name => {
+                        let keys = Object.keys(objType.props);
+                        let out = keys.map(key => `${this.type(objType.props[key], 'js_' + key)} = {0};\nbool has_${key} = false;\n`).join('');
+                        let cases = keys.map(key => `if (json_token_equals(key, "${key}", ${key.length})) {\n    js_${key} = ${this.jsonRead(objType.props[key], 'p')};\n    has_${key} = true;\n} else `).join('');
+                        out += `if (json_object_begin(p)) {\n    do {\n        json_token key = json_parse_key(p);\n${this.indent(this.indent(cases + '{\n    json_skip_value(p);\n}'))}\n    } while (json_object_next(p));\n}\n`;
+                        out += keys.map(key => `if (!has_${key}) {\n    json_error(p, "Missing property ${key}");\n}\n`).join('');
+                        return [`${struct}* ${name}(json_parser* p)`, out + `return create_${struct}(${keys.map(key => 'js_' + key).join(', ')});`];
+                    });
+                } else if (type.specialName === 'array' && type.indexes.length === 1) {
+                    let elt = this.simplify(type.indexes[0].value);
+                    let item = this.jsonRead(elt, 'p');
+                    let push: string;
+                    if (kind) {
+                        push = `${kind}_array_push(out, ${item});`;
+                    } else {
+                        push = `any* item = malloc(sizeof(any));\n*item = ${elt.type === 'union' ? `union_to_any(${item})` : this.anyValue(item, elt)};\narray_push(out, item);`;
+                    }
+                    let ctype = this.type(type);
+                    return this.jsonFunction('read', type, name => [`${ctype} ${name}(json_parser* p)`, `${ctype} out = create_${kind ? kind + '_' : ''}array(0);\nif (json_array_begin(p)) {\n    do {\n${this.indent(this.indent(push))}\n    } while (json_array_next(p));\n}\nreturn out;`]);
+                }
+                break;
+        }
+        this.error('TypeError', `Cannot decode JSON as type ${type}`);
+    }
+
+    // C statements that write value of type to the json_writer* writer
+    jsonWrite(type: Type, value: string, writer: string): string {
+        type = this.simplify(type);
+        switch (type.type) {
+            case 'number':
+            case 'number_value':
+                return `json_write_number(${writer}, ${value});`;
+            case 'string':
+            case 'string_value':
+                return `json_write_string(${writer}, ${value});`;
+            case 'boolean':
+            case 'boolean_value':
+                return `json_write_boolean(${writer}, ${value});`;
+            case 'undefined':
+            case 'null':
+                return `(void)(${value});\njson_write_literal(${writer}, "null");`;
+            case 'any':
+                return `json_write_unknown(${writer}, ${value});`;
+            case 'union':
+                if (type.types.every(member => JSON_TAGS[member.type.replace('_value', '')] !== undefined)) {
+                    return `json_write_unknown(${writer}, union_to_unknown(${value}));`;
+                }
+                break;
+            case 'object':
+                let kind = this.packedArrayKind(type);
+                if (this.isClosedObject(type)) {
+                    let objType = type;
+                    let name = this.jsonFunction('write', type, name => {
+                        // undefined and functions are left out, like JSON.stringify does
+                        let keys = Object.keys(objType.props).filter(key => objType.props[key].type !== 'undefined' && !(objType.props[key].type === 'object' && (objType.props[key] as t.Object).call));
+                        // so are the keys of a union or any that hold undefined at run time, up to the first key that is always written the commas depend on them
+                        let props = keys.map(key => {
+                            let type = this.simplify(objType.props[key]);
+                            let value = 'value->js_' + key;
+                            let tag: string | null = null;
+                            if (type.type === 'any') {
+                                tag = `unknown_type(${value})`;
+                            } else if (type.type === 'union' && type.types.some(member => member.type === 'undefined')) {
+                                tag = `union_type(${value})`;
+                            }
+                            return {key, type, value, tag};
+                        });
+                        let always = props.findIndex(prop => !prop.tag);
+                        let dynamic = always < 0 ? props.length : always;
+                        let tracked = props.length > 1 && props[0].tag !== null;
+                        let out = tracked ? 'bool first = true;\n' : '';
+                        for (let [i, {key, type, value, tag}] of props.entries()) {
+                            let label = `\\"${key}\\":`;
+                            let write: string;
+                            if (i === 0) {
+                                write = `json_write_literal(w, "${tag ? '' : '{'}${label}");\n`;
+                                if (tag) {
+                                    out += 'json_write_literal(w, "{");\n';
+                                }
+                            } else if (tracked && i <= dynamic) {
+                                write = `if (!first) {\n    json_write_literal(w, ",");\n}\njson_write_literal(w, "${label}");\n`;
+                            } else {
+                                write = `json_write_literal(w, ",${label}");\n`;
+                            }
+                            if (tag && i < dynamic && i + 1 < props.length) {
+                                write += 'first = false;\n';
+                            }
+                            write += this.jsonWrite(type, value, 'w');
+                            out += tag ? `if (${tag} != UNDEFINED_TAG) {\n${this.indent(write)}\n}\n` : write + '\n';
+                        }
+                        return [`void ${name}(json_writer* w, ${this.type(objType)} value)`, out + `json_write_literal(w, "${props.length === 0 ? '{' : ''}}");`];
+                    });
+                    return `${name}(${writer}, ${value});`;
+                } else if (type.specialName === 'array' && type.indexes.length === 1) {
+                    let elt = this.simplify(type.indexes[0].value);
+                    let item: string;
+                    if (kind) {
+                        item = this.jsonWrite(elt, 'value->items[i]', 'w');
+                    } else if (elt.type === 'any' || elt.type === 'union') {
+                        this.error('TypeError', `Cannot write an array of ${elt} to JSON, its elements are stored without their types`);
+                    } else {
+                        item = `if (value->items[i] == NULL) {\n    json_write_literal(w, "null");\n} else {\n${this.indent(this.jsonWrite(elt, this.fromAnyValue('(*value->items[i])', elt), 'w'))}\n}`;
+                    }
+                    let arrType = type;
+                    let name = this.jsonFunction('write', type, name => [`void ${name}(json_writer* w, ${this.type(arrType)} value)`, `json_write_literal(w, "[");\nfor (uint32_t i = 0; i < value->length; i++) {\n    if (i > 0) {\n        json_write_literal(w, ",");\n    }\n${this.indent(item)}\n}\njson_write_literal(w, "]");`]);
+                    return `${name}(${writer}, ${value});`;
+                }
+                break;
+        }
+        this.error('TypeError', `Cannot write a value of type ${type} to JSON`);
+    }
+
+    // JSON.parse(text), and JSON.parse(text) as T, which decodes straight into T's layout without building a dynamic value first
+    jsonParse(node: b.CallExpression | b.OptionalCallExpression, type: Type): string {
+        let arg = node.arguments[0];
+        if (node.arguments.length !== 1 || arg.type === 'SpreadElement' || arg.type === 'ArgumentPlaceholder') {
+            this.error('TypeError', 'JSON.parse takes exactly one argument, revivers are not supported');
+        }
+        let text = this.toString(this.expression(arg), this.simplify(this.infer.expression(arg)));
+        type = this.simplify(type);
+        if (type.type === 'any') {
+            return `json_parse(${text})`;
+        }
+        let parser = 'json_' + Generator.nextTemp++;
+        return `({json_parser ${parser}; json_parser_init(&${parser}, ${text}); ${this.type(type)} ${parser}_out = ${this.jsonRead(type, '&' + parser)}; json_parser_end(&${parser}); ${parser}_out;})`;
+    }
+
+    jsonStringify(node: b.CallExpression | b.OptionalCallExpression): string {
+        let arg = node.arguments[0];
+        if (node.arguments.length !== 1 || arg.type === 'SpreadElement' || arg.type === 'ArgumentPlaceholder') {
+            this.error('TypeError', 'JSON.stringify takes exactly one argument, replacers and indentation are not supported');
+        }
+        let type = this.simplify(this.infer.expression(arg));
+        if (type.type === 'undefined' || (type.type === 'object' && type.call)) {
+            this.error('TypeError', `JSON.stringify of a value of type ${type} is undefined, not a string`);
+        }
+        let writer = 'json_' + Generator.nextTemp++;
+        return `({json_writer ${writer}; json_writer_init(&${writer}); ${this.jsonWrite(type, this.expression(arg), '&' + writer).split('\n').join(' ')} json_writer_finish(&${writer});})`;
+    }
+
     identifier(name: string, isFunction: boolean = false): string {
         if (this.globalVarExists(name) && !this.globalIsShadowed(name)) {
             return 'js_global' + (isFunction ? 'function' : '') + '_' + name;
@@ -135,80 +1178,461 @@ export class Generator extends ASTManipulator {
         }
     }
 
+    // the env of frames[i] as seen from the innermost function
+    // a closure gets the env of the function it was created in as outer, and reaches the ones further out through pointers in that
+    env(i: number): string {
+        let top = this.frames.length - 1;
+        this.frames[i].hasEnv = true;
+        if (i === top) {
+            return 'env';
+        } else if (i === top - 1) {
+            return 'outer';
+        } else {
+            this.frames[top - 1].outers.add(this.frames[i]);
+            return `outer->outer_${this.frames[i].index}`;
+        }
+    }
+
+    // a variable of the innermost function or one around it that lives in an env, or null if it is a C local or global
+    frameVariable(name: string): string | null {
+        if (this.inlineParams.has(name)) {
+            return null;
+        }
+        for (let i = this.frames.length - 1; i >= 0; i--) {
+            let frame = this.frames[i];
+            if (frame.declared.has(name)) {
+                if (!frame.captured.has(name)) {
+                    return null;
+                }
+                if (!frame.types.has(name)) {
+                    frame.types.set(name, this.getVar(name));
+                }
+                return `${this.env(i)}->js_${name}`;
+            } else if (frame.functions.has(name)) {
+                return null;
+            }
+        }
+        return null;
+    }
+
+    // the C function a name bound by a function declaration calls, the env to call it with and its value as a closure*
+    functionBinding(name: string): {name: string, env: string, value: string} | null {
+        if (this.inlineParams.has(name)) {
+            return null;
+        }
+        for (let i = this.frames.length - 1; i >= 0; i--) {
+            let frame = this.frames[i];
+            if (frame.declared.has(name)) {
+                return null;
+            }
+            let func = frame.functions.get(name);
+            if (func) {
+                if (this.isClosure(func.node, i)) {
+                    let env = this.env(i);
+                    return {name: func.name, env, value: `create_closure(${func.name}, ${env})`};
+                }
+                return {name: func.name, env: 'NULL', value: `&${func.name}_closure`};
+            }
+        }
+        if (this.moduleFunctions.has(name) || this.importedFunctions.has(name)) {
+            let cName = this.moduleFunctions.has(name) ? `js_function_${this.id}_${name}` : this.identifier(name);
+            return {name: cName, env: 'NULL', value: `&${cName}_closure`};
+        }
+        return null;
+    }
+
+    // whether a function nested in frames[depth] uses a variable of it or a function around it, directly or by calling a closure
+    isClosure(node: b.Function, depth: number, seen: Set<b.Function> = new Set()): boolean {
+        if (seen.has(node)) {
+            return false;
+        }
+        seen.add(node);
+        for (let name of freeNames(node)) {
+            for (let i = depth; i >= 0; i--) {
+                let frame = this.frames[i];
+                if (frame.declared.has(name)) {
+                    return true;
+                }
+                let func = frame.functions.get(name);
+                if (func) {
+                    if (this.isClosure(func.node, i, seen)) {
+                        return true;
+                    }
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    // envs are made once per call, so a let or const of a loop that a function made in the loop uses would be shared by every iteration instead of each getting its own
+    checkLoopCaptures(node: b.Function | b.Program): void {
+        let name = loopCapturedName(node);
+        if (name !== null) {
+            this.error('SyntaxError', `Functions that use the loop variable ${name} from inside its loop are not supported`);
+        }
+    }
+
+    // allocates the env of the innermost function, after its body has been generated so every variable and outer env it needs is known
+    prologue(frame: Frame, parent: Frame | null, params: string[]): string {
+        let out = '';
+        if (parent) {
+            out += `env_${this.id}_${parent.index}* outer = closure_env;\n`;
+        }
+        if (!frame.hasEnv) {
+            return out;
+        }
+        let name = `env_${this.id}_${frame.index}`;
+        let fields: string[] = [];
+        let pointers: string[] = [];
+        let init: string[] = [];
+        for (let key of frame.captured) {
+            let type = frame.types.get(key);
+            if (type) {
+                fields.push(this.type(type, 'js_' + key) + ';');
+                let pointer = this.gcPointerOffset(name, key, type);
+                if (pointer) {
+                    pointers.push(pointer);
+                }
+                if (params.includes(key)) {
+                    init.push(`env->js_${key} = js_variable_${this.id}_${key};`);
+                }
+            }
+        }
+        for (let outer of frame.outers) {
+            fields.push(`struct env_${this.id}_${outer.index}* outer_${outer.index};`);
+            pointers.push(`offsetof(${name}, outer_${outer.index})`);
+            init.push(`env->outer_${outer.index} = ${this.env(this.frames.indexOf(outer))};`);
+        }
+        if (fields.length === 0) {
+            this.closureDecls.push(`typedef struct ${name} ${name};`);
+            return out + `${name}* env = NULL;\n`;
+        }
+        let decl = `typedef struct ${name} {\n${this.indent(fields.join('\n'))}\n} ${name};\n`;
+        if (pointers.length > 0) {
+            decl += `GC_TYPE(${name}_gc_type, ${name}, ${pointers.join(', ')});\n`;
+            out += `${name}* env = gc_malloc_typed(&${name}_gc_type);\n`;
+        } else {
+            out += `${name}* env = malloc_atomic(sizeof(${name}));\n`;
+        }
+        this.closureDecls.push(decl);
+        return out + init.join('\n') + (init.length > 0 ? '\n' : '');
+    }
+
     getDeclarations(header: boolean = false): string {
         let out: string[] = [];
+        let frame = this.frames[this.frames.length - 1];
         for (let [key, type] of this.scope.vars) {
+            if (frame && (frame.captured.has(key) || frame.functions.has(key))) {
+                continue;
+            }
             if (!this.scope.imports.has(key)) {
-                if (type.type === 'object' && type.call) {
+                if (type.type === 'object' && type.call && !frame && this.moduleFunctions.has(key)) {
                     if (header) {
-                        out.push(this.type(type, this.identifier(key, true), true) + '\n');
+                        out.push(this.signature(type.call, this.identifier(key, true), true) + ';\n');
+                        out.push(`extern closure ${this.identifier(key, true)}_closure CLOSURE_ALIGNED;\n`);
                     }
                     out.push(`${header ? 'extern ' : ''}object* js_variable_${this.id}_${key};\n`);
+                } else if (this.scope.ropes.has(key)) {
+                    out.push(`${header ? 'extern ' : ''}rope* ${this.identifier(key)};\n`);
                 } else {
-                    out.push(this.type(type, this.identifier(key), true) + '\n');
+                    out.push((header ? this.type(type, this.identifier(key), true) : this.type(type, this.identifier(key)) + ';') + '\n');
                 }
             }
         }
         return out.join('');
     }
 
+    // string variables that are appended to with += are kept as ropes, so building a string in a loop is linear
+    findRopes(nodes: b.Node[]): void {
+        let frame = this.frames[this.frames.length - 1];
+        let visit = (node: any): void => {
+            if (!node || typeof node.type !== 'string' || node.type.includes('Function') || node.type.startsWith('Class')) {
+                return;
+            }
+            if (node.type === 'AssignmentExpression' && node.operator === '+=' && node.left.type === 'Identifier' && !(frame && frame.captured.has(node.left.name))) {
+                let type = this.scope.vars.get(node.left.name);
+                if (type && (type.type === 'string' || type.type === 'string_value') && !this.scope.exports.has(node.left.name)) {
+                    this.scope.ropes.add(node.left.name);
+                }
+            }
+            for (let key in node) {
+                if (key === 'loc' || key === 'leadingComments' || key === 'trailingComments') {
+                    continue;
+                }
+                let value = node[key];
+                if (Array.isArray(value)) {
+                    value.forEach(visit);
+                } else if (value && typeof value === 'object') {
+                    visit(value);
+                }
+            }
+        };
+        nodes.forEach(visit);
+    }
+
+    // a closed object or non-empty packed array literal can go on the stack if it is only ever used through its fields, items and length
+    canStackAllocate(node: b.Expression): boolean {
+        let type = this.infer.expression(node);
+        if (node.type === 'ObjectExpression') {
+            return this.isClosedObject(type) && node.properties.every(prop => prop.type === 'ObjectProperty' && !prop.computed && prop.key.type === 'Identifier');
+        } else if (node.type === 'ArrayExpression') {
+            return this.packedArrayKind(type) !== null && node.elements.length > 0 && node.elements.every(elt => elt && elt.type !== 'SpreadElement');
+        } else {
+            return false;
+        }
+    }
+
+    // escape analysis for the let and const declarations directly in a block
+    // a candidate escapes as soon as it is used as anything but the object of a field access, so passing it anywhere, returning it, storing it, reassigning it, calling a method on it or capturing it in a closure all keep it on the heap
+    findStackAllocated(nodes: b.Statement[]): void {
+        let candidates: Map<string, b.VariableDeclarator> = new Map();
+        for (let node of nodes) {
+            if (node.type === 'VariableDeclaration' && node.kind !== 'var') {
+                for (let decl of node.declarations) {
+                    if (decl.id.type === 'Identifier' && !decl.id.typeAnnotation && decl.init && this.canStackAllocate(decl.init) && !this.scope.ropes.has(decl.id.name)) {
+                        candidates.set(decl.id.name, decl);
+                    }
+                }
+            }
+        }
+        if (candidates.size === 0) {
+            return;
+        }
+        let escapes = (node: b.Identifier, parent: any, grandparent: any): boolean => {
+            if (!parent || parent.type !== 'MemberExpression' || parent.object !== node) {
+                return true;
+            } else if ((grandparent.type === 'CallExpression' || grandparent.type === 'OptionalCallExpression') && grandparent.callee === parent) {
+                return true;
+            }
+            let type = this.infer.expression(candidates.get(node.name)!.init!);
+            if (this.isClosedObject(type)) {
+                return parent.computed || parent.property.type !== 'Identifier' || !(parent.property.name in type.props);
+            } else if (parent.computed) {
+                return !this.isNumeric(parent.property);
+            } else {
+                let written = (grandparent.type === 'AssignmentExpression' && grandparent.left === parent) || grandparent.type === 'UpdateExpression';
+                return written || parent.property.type !== 'Identifier' || parent.property.name !== 'length';
+            }
+        };
+        // a closure can outlive the block, so any use inside one is an escape
+        let visit = (node: any, parent: any, grandparent: any, nested: boolean): void => {
+            if (!node || typeof node.type !== 'string') {
+                return;
+            }
+            nested ||= node.type.includes('Function') || node.type.startsWith('Class') || node.type === 'ObjectMethod';
+            if (node.type === 'Identifier' && candidates.has(node.name)) {
+                let isDeclaration = parent && parent.type === 'VariableDeclarator' && parent.id === node && candidates.get(node.name) === parent;
+                let isKey = parent && (parent.type === 'MemberExpression' || parent.type === 'ObjectProperty') && !parent.computed && (parent.property === node || parent.key === node) && !(parent.type === 'ObjectProperty' && parent.shorthand);
+                if (!isDeclaration && !isKey && (nested || escapes(node, parent, grandparent))) {
+                    candidates.delete(node.name);
+                }
+                return;
+            }
+            for (let key in node) {
+                if (key === 'loc' || key === 'leadingComments' || key === 'trailingComments') {
+                    continue;
+                }
+                let value = node[key];
+                if (Array.isArray(value)) {
+                    value.forEach(x => visit(x, node, parent, nested));
+                } else if (value && typeof value === 'object') {
+                    visit(value, node, parent, nested);
+                }
+            }
+        };
+        nodes.forEach(node => visit(node, null, null, false));
+        for (let name of candidates.keys()) {
+            this.scope.stackAllocated.add(name);
+        }
+    }
+
+    // the C compiler scalar-replaces these, since their address never leaves the function
+    stackAllocate(node: b.Expression): string {
+        let type = this.infer.expression(node);
+        if (node.type === 'ObjectExpression' && this.isClosedObject(type)) {
+            let fields = (node.properties as b.ObjectProperty[]).map(prop => `.js_${(prop.key as b.Identifier).name} = ${this.expression(prop.value as b.Expression)}`);
+            return `&(${this.struct(type)}){${fields.join(', ')}}`;
+        } else if (node.type === 'ArrayExpression') {
+            let kind = this.packedArrayKind(type)!;
+            let items = this.packedArrayItems(node, kind);
+            let ctype = kind === 'number' ? 'double' : (kind === 'string' ? 'char*' : 'bool');
+            return `&(${kind}_array){.length = ${items.length}, .capacity = ${items.length}, .head = 0, .items = (${ctype}[]){${items.join(', ')}}}`;
+        } else {
+            this.error('InternalError', 'Expression cannot be stack allocated');
+        }
+    }
+
+    isRope(name: string): boolean {
+        for (let scope: Scope | null = this.scope; scope; scope = scope.parent) {
+            if (scope.vars.has(name)) {
+                return scope.ropes.has(name);
+            }
+        }
+        return false;
+    }
+
+    ropeAppend(node: b.AssignmentExpression & {left: b.Identifier}): string {
+        let name = this.identifier(node.left.name);
+        return `${name} = rope_append(${name}, ${this.toString(this.expression(node.right), this.simplify(this.infer.expression(node.right)))})`;
+    }
+
+    isRopeAppend(node: b.Expression): node is b.AssignmentExpression & {left: b.Identifier} {
+        return node.type === 'AssignmentExpression' && node.operator === '+=' && node.left.type === 'Identifier' && this.isRope(node.left.name);
+    }
+
+    // flattens a chain of string +s and template literals into one allocation
+    stringParts(node: b.Expression): string[] {
+        if (node.type === 'BinaryExpression' && node.operator === '+' && this.isConcat(node)) {
+            return [...this.stringParts(node.left as b.Expression), ...this.stringParts(node.right)];
+        } else if (node.type === 'TemplateLiteral') {
+            let out: string[] = [];
+            for (let i = 0; i < node.quasis.length; i++) {
+                let quasi = node.quasis[i].value.cooked ?? node.quasis[i].value.raw;
+                if (quasi !== '') {
+                    out.push(this.string(quasi));
+                }
+                if (i < node.expressions.length) {
+                    out.push(...this.stringParts(node.expressions[i] as b.Expression));
+                }
+            }
+            return out;
+        } else if (node.type === 'StringLiteral') {
+            return node.value === '' ? [] : [this.string(node.value)];
+        } else {
+            return [this.toString(this.expression(node), this.simplify(this.infer.expression(node)))];
+        }
+    }
+
+    isConcat(node: b.BinaryExpression): boolean {
+        if (node.left.type === 'PrivateName') {
+            return false;
+        }
+        let leftType = this.simplify(this.infer.expression(node.left));
+        let rightType = this.simplify(this.infer.expression(node.right));
+        return this.infer.expression(node).type === 'string' && leftType.type !== 'union' && rightType.type !== 'union';
+    }
+
+    concat(parts: string[]): string {
+        if (parts.length === 0) {
+            return this.string('');
+        } else if (parts.length === 1) {
+            return parts[0];
+        } else {
+            return `string_concat(${parts.length}, ${parts.join(', ')})`;
+        }
+    }
+
+    // every function takes the env of its closure and this first, function values are closure*
+    // variables used by the functions nested in a function live in an env allocated once per call of it, the rest stay C locals
+    // functions that use them are closures of the env of the function they were created in, the others get a static closure record
     function(node: b.Function): string {
-        let name = 'id' in node && node.id ? 'js_function_' + this.id + '_' + node.id.name : 'js_anon_' + Generator.nextAnon++;
+        let depth = this.frames.length - 1;
+        let parent = depth >= 0 ? this.frames[depth] : null;
+        let name: string;
+        if (node.type === 'FunctionDeclaration' && node.id) {
+            name = parent ? parent.functions.get(node.id.name)!.name : 'js_function_' + this.id + '_' + node.id.name;
+        } else {
+            name = 'js_anon_' + this.id + '_' + this.nextAnon++;
+        }
+        let isClosure = parent !== null && this.isClosure(node, depth);
         let type = this.infer.function(node.params, node.typeParameters, node.returnType).call;
         if (!type) {
             this.error('InternalError', 'Not a function');
         }
-        let out = this.type(type.returnType) + ' ' + name + '(object* this' + (node.params.length > 0 ? ', ' + node.params.map((param, index) => {
+        let params = node.params.map(param => {
             if (param.type !== 'Identifier') {
                 this.error('InternalError', `Complicated lvalue encountered in Generator.function() of type ${node.type}`)
-            } else {
-                return this.type(type.params[index][1], 'js_variable_' + this.id + '_' + param.name);
             }
-        }).join(', ') : '') + ') ';
+            return param.name;
+        });
+        this.checkLoopCaptures(node);
+        let out = this.type(type.returnType) + ' ' + name + '(void* closure_env, object* this' + params.map((param, index) => ', ' + this.type(type.params[index][1], 'js_variable_' + this.id + '_' + param)).join('') + ') {\n';
+        let frame: Frame = {index: this.nextFrame++, declared: declaredNames(node), captured: capturedNames(node), constants: constantNames(node), types: new Map(), functions: new Map(), outers: new Set(), hasEnv: false};
+        for (let func of functionDeclarations(node)) {
+            frame.functions.set(func.id!.name, {name: `js_function_${this.id}_${func.id!.name}_${this.nextAnon++}`, node: func});
+        }
+        this.frames.push(frame);
         let wasGlobal = this.isGlobal;
         this.isGlobal = false;
         this.pushScope();
         for (let [name, paramType] of type.params) {
             this.scope.set(name, paramType);
         }
+        let body: string;
         if (node.body.type === 'BlockStatement') {
-            out += '{\n';
             node.body.body.forEach(x => this.infer.statement(x));
-            out += this.indent((this.getDeclarations() + node.body.body.map(x => this.statement(x))).slice(0, -1));
+            this.findRopes(node.body.body);
+            this.findStackAllocated(node.body.body);
+            body = this.indent((this.getDeclarations() + node.body.body.map(x => this.statement(x))).slice(0, -1));
             if (type.returnType.type === 'undefined') {
-                out += '\n    return NULL;';
+                body += '\n    return NULL;';
             } else if (type.returnType.type === 'any') {
-                out += `\n    return create_any_from_undefined(NULL);`;
+                body += `\n    return create_unknown_from_undefined(NULL);`;
             }
-            out += '\n}\n';
         } else {
-            out += '{\n    return ' + this.expression(node.body) + ';\n}';
+            body = '    return ' + this.expression(node.body) + ';';
         }
-        this.isGlobal = wasGlobal;
-        if ('id' in node && node.id) {
-            this.topLevel += 'js_variable_' + this.id + '_' + node.id.name + ' = ' + 'create_object(NULL, 1, "prototype", create_object(NULL, 0));\n';
+        let prologue = this.prologue(frame, isClosure ? parent : null, params);
+        if (prologue !== '') {
+            out += this.indent(prologue.slice(0, -1)) + '\n';
         }
+        out += body + '\n}\n';
+        this.isGlobal = wasGlobal;
         this.popScope();
+        this.frames.pop();
+        if (node.type === 'FunctionDeclaration' && node.id && !parent) {
+            this.topLevel += 'js_variable_' + this.id + '_' + node.id.name + ' = ' + `create_object(NULL, 1, ${this.atom('prototype')}, (any){.object = create_object(NULL, 0)});\n`;
+            this.closureDecls.push(`closure ${name}_closure CLOSURE_ALIGNED = {(void*)${name}, NULL};`);
+        } else {
+            this.closureDecls.push(this.signature(type, name, true) + ';');
+            if (!isClosure) {
+                this.closureDecls.push(`static closure ${name}_closure CLOSURE_ALIGNED = {(void*)${name}, NULL};`);
+            }
+        }
         this.functions.push(out);
-        return name;
+        return isClosure ? `create_closure(${name}, ${this.env(depth)})` : `&${name}_closure`;
     }
 
-    assignment(node: b.LVal | b.OptionalMemberExpression, value: string): string {
+    // valueType is the type of value, objects that aren't closed store it as an any, it defaults to what the target is inferred to hold
+    assignment(node: b.LVal | b.OptionalMemberExpression, value: string, valueType?: Type): string {
         this.setSourceData(node);
         switch (node.type) {
             case 'Identifier':
+                if (this.isRope(node.name)) {
+                    return `${this.identifier(node.name)} = rope_from_string(${value})`;
+                }
                 return this.expression(node) + ' = ' + value;
             case 'MemberExpression':
                 let [prop, type] = this.property(node.property);
                 let obj = this.expression(node.object);
                 let objType = this.infer.expression(node.object);
+                if (this.isClosedObject(objType) && node.property.type === 'Identifier' && !node.computed && node.property.name in objType.props) {
+                    return `${obj}->js_${node.property.name} = ${value}`;
+                } else if (this.packedArrayKind(objType) && node.computed && this.isNumeric(node.property)) {
+                    let index = this.integerIndex(node.property);
+                    if (index) {
+                        return `${this.packedArrayKind(objType)}_array_set_at(${obj}, ${index}, ${value})`;
+                    }
+                    return `${this.packedArrayKind(objType)}_array_set(${obj}, ${this.expression(node.property as b.Expression)}, ${value})`;
+                }
+                let kind = this.typedArrayKind(objType);
+                if (kind && NUMBER_TYPED_ARRAYS.includes(kind) && node.computed && this.isNumeric(node.property)) {
+                    let element = this.boundedElement(node, kind);
+                    if (element) {
+                        let temp = 'value_' + Generator.nextTemp++;
+                        return `({double ${temp} = ${value}; ${element} = ${kind}_from_value(${temp}); ${temp};})`;
+                    }
+                    return `${kind}_set_index(${obj}, ${this.expression(node.property as b.Expression)}, ${value})`;
+                }
+                let stored = this.anyValue(value, valueType ?? this.infer.expression(node));
                 switch (objType.type) {
                     case 'object':
-                        return `set_object_${type}(${obj}, ${prop})`;
+                        return `set_object_${type.type}(${obj}, ${prop}, ${stored})`;
                     case 'any':
-                        return `set_any_${type}(${obj}, ${prop})`;
+                        return `set_any_${type.type}(${obj}, ${prop}, ${stored})`;
                     default:
-                        this.error('TypeError', `Cannot set properties of ${type.type} (setting ${prop}`);                    
+                        this.error('TypeError', `Cannot set properties of ${objType.type} (setting ${prop})`);
                 }
             default:
                 this.error('InternalError', `Complicated lvalue encountered in Generator.assignment() of type ${node.type}`)
@@ -218,6 +1642,8 @@ export class Generator extends ASTManipulator {
     getCTypeName(type: t.NonUnionSimpleType): CTypeName {
         if (type.type === 'any') {
             return 'unknown';
+        } else if (type.type === 'object' && type.call) {
+            return 'function';
         } else if (type.type === 'object' && type.specialName) {
             if (type.specialName === 'symbolFunction') {
                 return 'function';
@@ -240,7 +1666,10 @@ export class Generator extends ASTManipulator {
     }
 
     getUnionFunc(func: UnionFunc, ...argTypes: SimpleType[]): string {
-        let args = argTypes.map(type => type.type === 'union' ? new Set(type.types.map(type => this.getCTypeName(type))) : this.getCTypeName(type));
+        let args = argTypes.map(type => type.type === 'union' ? new Set(type.types.map(type => {
+            let name = this.getCTypeName(type);
+            return name === 'unknown' ? name : getDispatchType(name);
+        })) : this.getCTypeName(type));
         for (let arg of args) {
             if (arg instanceof Set) {
                 for (let type of arg) {
@@ -252,21 +1681,34 @@ export class Generator extends ASTManipulator {
                 return func;
             }
         }
-        let newCall: UnionFuncCall = {func, args: args as UnionFuncCall['args']};
-        let cFunc = getCUnionFuncName(newCall);
-        let found = false;
-        for (let call of this.compiler.unionFuncCalls) {
-            if (unionFuncCallsAreEqual(call, newCall)) {
-                return cFunc;
+        let call: UnionFuncCall = {func, args: args as UnionFuncCall['args']};
+        // sites are numbered in generation order, which is the same in both builds of a PGO run
+        if (this.compiler.profileMode && !this.inStruct && args.some(arg => arg instanceof Set)) {
+            let site = this.nextProfileSite++;
+            let siteName = this.compiler.getPathFromRoot(this.fullPath) + '#' + site;
+            if (this.compiler.profileMode === 'use') {
+                call.hot = this.compiler.getHotTypes(siteName, call);
+            } else {
+                let name = `profile_site_${this.id}_${site}`;
+                let wrapper = `profiled_${this.id}_${site}`;
+                this.profileSites.push(`static profile_site ${name} = {"${siteName}"};\n${createProfiledUnionFunc(this.compiler.addUnionFuncCall(call), wrapper, name, this.config.nanBoxing)}`);
+                return wrapper;
             }
         }
-        this.compiler.unionFuncCalls.push(newCall);
-        return cFunc;
+        return getCUnionFuncName(this.compiler.addUnionFuncCall(call));
     }
 
     toAny(value: string, type: SimpleType): string {
         if (type.type === 'union') {
             return this.getUnionFunc('to_any', type) + '(' + value + ')';
+        }
+        this.escape(type);
+        if (this.isClosedObject(type)) {
+            return `create_unknown_from_object(${this.struct(type)}_to_object(${value}))`;
+        } else if (this.packedArrayKind(type)) {
+            return `create_unknown_from_array(cast_${this.packedArrayKind(type)}_array_to_any_array(${value}))`;
+        } else if (type.type === 'object' && type.call) {
+            return `create_unknown_from_function(${this.closure(value, type.call)})`;
         } else {
             return `create_unknown_from_${type.type.replace('_value', '').replace('unique_', '')}(${value})`;
         }
@@ -281,9 +1723,11 @@ export class Generator extends ASTManipulator {
             case 'number':
                 return value;
             case 'string':
-                return `(${value} == '\0')`;
+                return `(string_length(${value}) != 0)`;
             case 'any':
                 return `any_to_boolean(${value})`;
+            case 'union':
+                return this.getUnionFunc('to_boolean', type) + '(' + value + ')';
             default:
                 return `(${value}, true)`;
         }
@@ -314,7 +1758,9 @@ export class Generator extends ASTManipulator {
                             this.error('InternalError', `Invalid special name: ${type.specialName}`);
                     }
                 }
-                return `any_to_number(object_to_primitive(${value}))`;
+                return `any_to_number(object_to_primitive(${this.castObject(t.object(), value, type)}))`;
+            case 'union':
+                return this.getUnionFunc('to_number', type) + '(' + value + ')';
             default:
                 return `any_to_number(${value})`;
         }
@@ -325,17 +1771,17 @@ export class Generator extends ASTManipulator {
             case 'any':
                 return `to_string(${value})`;
             case 'undefined':
-                return `(${value}, "undefined")`;
+                return `(${value}, ${this.string('undefined')})`;
             case 'null':
-                return `(${value}, "null")`;
+                return `(${value}, ${this.string('null')})`;
             case 'boolean':
-                return `(${value} ? "true" : "false")`;
+                return `(${value} ? ${this.string('true')} : ${this.string('false')})`;
             case 'boolean_value':
-                return type.value ? '"true"' : '"false"';
+                return this.string(String(type.value));
             case 'number':
                 return `number_to_string(${value}, 10)`;
             case 'number_value':
-                return `"${value}"`;
+                return this.string(String(type.value));
             case 'string':
             case 'string_value':
                 return value;
@@ -347,7 +1793,7 @@ export class Generator extends ASTManipulator {
             case 'bigint_value':
                 return `(${value}, "${type.value}")`;
             case 'object':
-                return `to_string(object_to_primitive(${value}))`;
+                return `to_string(object_to_primitive(${this.castObject(t.object(), value, type)}))`;
             default:
                 return this.getUnionFunc('to_string', type) + '(' + value + ')';
         }
@@ -366,6 +1812,25 @@ export class Generator extends ASTManipulator {
             case 'string':
             case 'string_value':
                 return this.toString(value, type);
+            case 'object':
+                if (type.type === 'object') {
+                    return this.castObject(newType, value, type);
+                }
+            case 'union':
+                if (type.type === 'union') {
+                    return value;
+                } else if (type.type !== 'any') {
+                    this.escape(type);
+                    if (this.isClosedObject(type)) {
+                        return `create_union_from_object(${this.struct(type)}_to_object(${value}))`;
+                    } else if (this.packedArrayKind(type)) {
+                        return `create_union_from_array(cast_${this.packedArrayKind(type)}_array_to_any_array(${value}))`;
+                    } else if (type.type === 'object' && type.call) {
+                        return `create_union_from_function(${this.closure(value, type.call)})`;
+                    }
+                    let name = this.getCTypeName(type as t.NonUnionSimpleType);
+                    return `create_union_from_${getDispatchType(name as UnionType)}(${name in {undefined: 0, null: 0} ? 'NULL' : value})`;
+                }
             default:
                 this.error('TypeError', `Cannot cast to type ${newType} from type ${type}. This may mean you passed an invalid argument to a function.`);
         }
@@ -384,13 +1849,13 @@ export class Generator extends ASTManipulator {
     typeof(value: string, type: SimpleType): string {
         switch (type.type) {
             case 'null':
-                return `(${value}, "object")`;
+                return `(${value}, ${this.string('object')})`;
             case 'any':
                 return `typeof(${value})`;
             case 'union':
                 return this.getUnionFunc('typeof', type) + '(' + value + ')';
             default:
-                return `(${value}, "${type}")`;
+                return `(${value}, ${this.string(type.type === 'object' ? (type.call ? 'function' : 'object') : type.type.replace('_value', '').replace('unique_', ''))})`;
         }
     }
 
@@ -416,7 +1881,7 @@ export class Generator extends ASTManipulator {
                 return `eq_primitive(${this.toPrimitiveString(x, xType)}, ${this.toPrimitiveString(y, yType)})`;
             }
         } else if (xt === 'string' || yt === 'string') {
-            return `(strcmp(${this.toString(x, xType)}, ${this.toString(y, yType)}) == 0)`;
+            return `string_equals(${this.toString(x, xType)}, ${this.toString(y, yType)})`;
         } else {
             return `(${x} == ${y})`;
         }
@@ -434,7 +1899,7 @@ export class Generator extends ASTManipulator {
         } else if (xt === 'undefined' || xt === 'null') {
             return `(${x}, ${y}, true)`;
         } else if (xt === 'string') {
-            return `(strcmp(${x}, ${y}) == 0)`;
+            return `string_equals(${x}, ${y})`;
         } else {
             return `(${x} == ${y})`
         }
@@ -442,9 +1907,22 @@ export class Generator extends ASTManipulator {
 
     expression(node: b.Expression | b.PrivateName | b.V8IntrinsicIdentifier | b.FunctionDeclaration | b.ClassDeclaration | b.TSDeclareFunction): string {
         this.setSourceData(node);
+        let evaluated = this.evaluated.get(node);
+        if (evaluated) {
+            return evaluated;
+        }
         switch (node.type) {
             case 'Identifier':
-                return this.identifier(node.name);
+                if (this.isRope(node.name)) {
+                    return `rope_flatten(${this.identifier(node.name)})`;
+                }
+                let bound = this.functionBinding(node.name);
+                if (bound) {
+                    return bound.value;
+                } else if (this.infer.integerVars.has(node.name)) {
+                    return `((double)${this.identifier(node.name)})`;
+                }
+                return this.frameVariable(node.name) ?? this.identifier(node.name);
             case 'PrivateName':
                 this.error('SyntaxError', 'Private names are not supported');
             case 'RegExpLiteral':
@@ -482,7 +1960,10 @@ export class Generator extends ASTManipulator {
             case 'AwaitExpression':
                 return 'await(' + this.expression(node.argument) + ')';
             case 'ArrayExpression':
-                if (node.elements.length === 0) {
+                let arrayType = this.infer.expression(node);
+                if (this.packedArrayKind(arrayType)) {
+                    return this.packedArray(node, arrayType);
+                } else if (node.elements.length === 0) {
                     return 'create_array(0)';
                 } else {
                     return 'create_array_with_items(' + node.elements.length + ', ' + node.elements.map(elt => {
@@ -497,6 +1978,16 @@ export class Generator extends ASTManipulator {
                     }).join(', ') + ')';
                 }
             case 'ObjectExpression':
+                let literalType = this.infer.expression(node);
+                if (this.isClosedObject(literalType)) {
+                    let fields: {[key: string]: string} = {};
+                    for (let prop of node.properties) {
+                        if (prop.type === 'ObjectProperty' && prop.key.type === 'Identifier') {
+                            fields[prop.key.name] = this.expression(prop.value as b.Expression);
+                        }
+                    }
+                    return `create_${this.struct(literalType)}(${Object.keys(literalType.props).map(key => fields[key]).join(', ')})`;
+                }
                 if (node.properties.length === 0) {
                     return 'create_object(object_prototype, 0)';
                 } else {
@@ -505,6 +1996,9 @@ export class Generator extends ASTManipulator {
                             this.error('SyntaxError', 'Spread elements are not supported');
                         } else {
                             let [key, type] = this.property(prop.key);
+                            if (type.type === 'string') {
+                                key = `intern(${key})`;
+                            }
                             if (prop.type === 'ObjectMethod') {
                                 return key + ', ' + this.function(prop);
                             } else {
@@ -542,6 +2036,9 @@ export class Generator extends ASTManipulator {
             case 'UpdateExpression':
                 return (node.prefix ? '' : 'postfix_' + (node.operator === '++' ? 'inc' : 'dec')) + '(' + this.expression(node.argument) + ')';
             case 'BinaryExpression':
+                if (node.operator === '+' && this.isConcat(node)) {
+                    return this.concat(this.stringParts(node));
+                }
                 let left = this.expression(node.left);
                 let leftType = this.simplify(this.infer.expression(node.left));
                 let right = this.expression(node.right);
@@ -557,7 +2054,9 @@ export class Generator extends ASTManipulator {
                             return '!' + this.seq(left, leftType, right, rightType);
                         case '+':
                             let type = this.infer.expression(node);
-                            if (type.type === 'string') {
+                            if (leftType.type === 'union' || rightType.type === 'union') {
+                                return this.getUnionFunc('add', leftType, rightType) + '(' + left + ', ' + right + ')';
+                            } else if (type.type === 'string') {
                                 return `stradd(${this.toString(left, leftType)}, ${this.toString(right, rightType)})`;
                             } else {
                                 return this.toNumber(left, leftType) + ' + ' + this.toNumber(right, rightType);
@@ -578,11 +2077,13 @@ export class Generator extends ASTManipulator {
                         case '&':
                         case '^':
                         case '|':
+                            return `(double)(${this.bitwiseOperand(node.left, left, leftType)} ${node.operator} ${this.bitwiseOperand(node.right, right, rightType)})`;
                         case '<<':
-                        case '>>>':
-                            return `(double)((uint32_t)${this.toNumber(left, leftType)} ${node.operator} (uint32_t)${this.toNumber(right, rightType)})`;
+                            return `(double)(int32_t)(${this.bitwiseOperand(node.left, left, leftType, true)} << (${this.bitwiseOperand(node.right, right, rightType, true)} & 31))`;
                         case '>>':
-                            return `(double)((int32_t)${this.toNumber(left, leftType)} >>> (int32_t)${this.toNumber(right, rightType)})`;
+                            return `(double)(${this.bitwiseOperand(node.left, left, leftType)} >> (${this.bitwiseOperand(node.right, right, rightType, true)} & 31))`;
+                        case '>>>':
+                            return `(double)(${this.bitwiseOperand(node.left, left, leftType, true)} >> (${this.bitwiseOperand(node.right, right, rightType, true)} & 31))`;
                         case 'instanceof':
                             if (leftType.type === 'object' && rightType.type === 'object') {
                                 return `instanceof(${leftType}, ${rightType})`;
@@ -597,28 +2098,78 @@ export class Generator extends ASTManipulator {
             case 'LogicalExpression':
                 return this.expression(node.left) + ' ' + node.operator + ' ' + this.expression(node.right);
             case 'AssignmentExpression':
-                return this.assignment(node.left, this.expression(node.right));
+                if (this.isRopeAppend(node)) {
+                    return `rope_flatten(${this.ropeAppend(node)})`;
+                } else if (node.operator === '=') {
+                    return this.assignment(node.left, this.expression(node.right), this.infer.expression(node.right));
+                }
+                let operator = node.operator.slice(0, -1);
+                let logical = operator === '&&' || operator === '||' || operator === '??';
+                // the object and key of a.b op= c are read and written through, so they go in temporaries to be evaluated once
+                let temps: b.Node[] = [];
+                let setup = '';
+                if (node.left.type === 'MemberExpression') {
+                    for (let part of node.left.computed ? [node.left.object, node.left.property] : [node.left.object]) {
+                        if (!['Identifier', 'ThisExpression', 'NumericLiteral', 'StringLiteral'].includes(part.type)) {
+                            let temp = 'operand_' + Generator.nextTemp++;
+                            setup += `${this.type(this.infer.expression(part as b.Expression), temp)} = ${this.expression(part as b.Expression)}; `;
+                            this.evaluated.set(part, temp);
+                            temps.push(part);
+                        }
+                    }
+                }
+                let combined = {...node, type: logical ? 'LogicalExpression' : 'BinaryExpression', operator, left: node.left} as b.Expression;
+                let assigned = this.assignment(node.left, this.expression(combined), this.infer.expression(combined));
+                temps.forEach(part => this.evaluated.delete(part));
+                return setup === '' ? assigned : `({${setup}${assigned};})`;
             case 'MemberExpression':
             case 'OptionalMemberExpression':
+                if (node.object.type === 'Identifier' && this.isRope(node.object.name) && !node.computed && node.property.type === 'Identifier' && node.property.name === 'length') {
+                    // flattening is only needed for the characters
+                    return `rope_length(${this.identifier(node.object.name)})`;
+                }
                 let [prop, complexType] = this.property(node.property);
                 type = this.simplify(complexType);
                 let obj = this.expression(node.object);
                 let objType = this.infer.expression(node.object);
+                let ic: string | null;
                 if (objType.type === 'undefined' || objType.type === 'null') {
                     if (node.type === 'OptionalMemberExpression') {
                         return `(${prop}, ${obj})`;
                     } else {
                         this.error('TypeError', `Cannot read properties of ${objType.type} (reading ${prop})`);
                     }
+                } else if (this.isClosedObject(objType) && node.property.type === 'Identifier' && !node.computed && node.property.name in objType.props) {
+                    return `(${obj}->js_${node.property.name})`;
+                } else if (objType.type === 'any' && type.type === 'symbol' && (ic = this.inlineCache())) {
+                    return `${node.type === 'OptionalMemberExpression' ? 'optional_' : ''}get_any_symbol_ic(&${ic}, ${obj}, ${prop})`;
                 } else if (objType.type === 'any' && node.type === 'OptionalMemberExpression') {
                     return `optional_get_any_${type.type}(${obj}, ${prop})`;
-                } else if (objType.type === 'string' && prop === '"length"') {
-                    return `strlen(${obj})`;
-                } else if (objType.type === 'object' && objType.specialName === 'array' && prop === '"length"') {
+                } else if (objType.type === 'string' && prop === this.atom('length')) {
+                    return `string_length(${obj})`;
+                } else if (objType.type === 'object' && (objType.specialName === 'array' || this.typedArrayKind(objType)) && prop === this.atom('length')) {
                     return `(${obj}->length)`;
+                } else if (this.packedArrayKind(objType) && node.computed && this.isNumeric(node.property)) {
+                    let index = this.integerIndex(node.property);
+                    if (index) {
+                        return `${this.packedArrayKind(objType)}_array_get_at(${obj}, ${index})`;
+                    }
+                    return `${this.packedArrayKind(objType)}_array_get(${obj}, ${this.expression(node.property as b.Expression)})`;
+                } else if (this.typedArrayKind(objType) && NUMBER_TYPED_ARRAYS.includes(this.typedArrayKind(objType)!) && node.computed && this.isNumeric(node.property)) {
+                    let kind = this.typedArrayKind(objType)!;
+                    let element = this.boundedElement(node, kind);
+                    return element ? `((double)${element})` : `${kind}_get_index(${obj}, ${this.expression(node.property as b.Expression)})`;
                 } else {
                     let outType = this.infer.expression(node);
                     if (outType.type === 'object' && outType.call && outType.call.cName) {
+                        let kind = this.packedArrayKind(objType);
+                        if (kind && PACKED_ARRAY_METHODS.includes(outType.call.cName)) {
+                            return kind + '_' + outType.call.cName;
+                        }
+                        let typedKind = this.typedArrayKind(objType);
+                        if (typedKind && outType.call.cName.startsWith('typedarray_')) {
+                            return typedKind + outType.call.cName.slice('typedarray'.length);
+                        }
                         return outType.call.cName;
                     } else {
                         return `get_${objType.type}_${type.type}(${obj}, ${prop})`;
@@ -631,6 +2182,16 @@ export class Generator extends ASTManipulator {
             case 'CallExpression':
             case 'OptionalCallExpression':
             case 'NewExpression':
+                let jsonMethod = node.type === 'NewExpression' ? null : this.jsonMethod(node);
+                if (jsonMethod === 'parse') {
+                    return this.jsonParse(node as b.CallExpression, t.any);
+                } else if (jsonMethod === 'stringify') {
+                    return this.jsonStringify(node as b.CallExpression);
+                }
+                let fused = node.type === 'CallExpression' ? this.fusedArrayLoop(node) : null;
+                if (fused) {
+                    return fused;
+                }
                 let args = node.arguments.map(arg => {
                     if (arg.type === 'SpreadElement') {
                         this.error('SyntaxError', 'Spread elements are not supported');
@@ -638,16 +2199,11 @@ export class Generator extends ASTManipulator {
                         return this.expression(arg as b.Expression);
                     }
                 });
-                let func: string;
-                if (node.callee.type === 'Identifier') {
-                    func = this.expression(node.callee);
-                    if (func.startsWith('js_variable')) {
-                        func = 'js_function' + func.slice(11);
-                    } else if (func.startsWith('js_global')) {
-                        func = 'js_globalfunction' + func.slice(9);
-                    }
-                } else {
-                    func = this.expression(node.callee);
+                let binding = node.callee.type === 'Identifier' ? this.functionBinding(node.callee.name) : null;
+                let callee = binding ? binding.name : this.expression(node.callee);
+                let func = callee;
+                if (node.callee.type === 'Identifier' && func.startsWith('js_global')) {
+                    func = 'js_globalfunction' + func.slice(9);
                 }
                 if (node.type === 'CallExpression' || node.type === 'OptionalCallExpression') {
                     let funcType = this.infer.expression(node.callee);
@@ -662,10 +2218,20 @@ export class Generator extends ASTManipulator {
                     }
                     let call = funcType.call;
                     let argsArray: string[] = [];
+                    // a packed receiver of an any[] method, it is boxed for the call and the elements are copied back after it
+                    let boxedThis: {kind: string, value: string, receiver: string, boxed: string, result: string} | null = null;
                     if (!call.noThis) {
                         if (node.callee.type === 'MemberExpression') {
-                            this.thisArgs.push(this.expression(node.callee.object));
-                            this.thisTypes.push(this.infer.expression(node.callee.object));
+                            let thisType = this.infer.expression(node.callee.object);
+                            let thisArg = this.expression(node.callee.object);
+                            let kind = this.packedArrayKind(thisType);
+                            if (kind && !(call.cName && PACKED_ARRAY_METHODS.includes(call.cName))) {
+                                let temp = Generator.nextTemp++;
+                                boxedThis = {kind, value: thisArg, receiver: 'receiver_' + temp, boxed: 'boxed_' + temp, result: 'result_' + temp};
+                                thisArg = boxedThis.boxed;
+                            }
+                            this.thisArgs.push(thisArg);
+                            this.thisTypes.push(thisType);
                         }
                         argsArray.push(this.thisArgs.value ?? 'NULL');
                     }
@@ -684,7 +2250,10 @@ export class Generator extends ASTManipulator {
                             out = '(' + out + ', ' + this.expression(call.params[i][2]) + ')';
                         }
                         if (type.type === 'object' && type.specialName === 'array' && call.thisIsAnyArray) {
-                            if (type.indexes.length > 0) {
+                            this.escape(type);
+                            if (this.packedArrayKind(type)) {
+                                out = `cast_${this.packedArrayKind(type)}_array_to_any_array(${out})`;
+                            } else if (type.indexes.length > 0) {
                                 out = `cast_array_to_any_array(${out}, ${this.string(type.indexes[0].value.type)})`;
                             } else {
                                 if (0 in type.props) {
@@ -694,7 +2263,7 @@ export class Generator extends ASTManipulator {
                                         length++;
                                         props.push(this.toAny(`out->items[${i}]`, type));
                                     }
-                                    return `create_array(${length}, ${props.join(', ')})`;
+                                    return `create_array_with_items(${length}, ${props.join(', ')})`;
                                 } else {
 
                                 }
@@ -702,10 +2271,36 @@ export class Generator extends ASTManipulator {
                         }
                         return this.to(this.simplify(call.params[i][1]), out, type);
                     }).filter(x => x !== undefined));
-                    return '((' + this.type(funcType) + ')' + this.expression(node.callee) + ')(' + argsArray.join(', ') + ')';
+                    if (binding) {
+                        return `${binding.name}(${[binding.env, ...argsArray].join(', ')})`;
+                    } else if (boxedThis) {
+                        let {kind, value, receiver, boxed, result} = boxedThis;
+                        let out = '((' + this.signature(call, '(*)', false) + ')' + callee + ')(' + argsArray.join(', ') + ')';
+                        let code = `${kind}_array* ${receiver} = ${value};\narray* ${boxed} = cast_${kind}_array_to_any_array(${receiver});\n`;
+                        if (!call.realVoid) {
+                            code += `${this.type(call.returnType)} ${result} = ${out};\n`;
+                        } else {
+                            code += out + ';\n';
+                        }
+                        if (call.cName && MUTATING_ARRAY_METHODS.includes(call.cName)) {
+                            code += `copy_any_array_to_${kind}_array(${receiver}, ${boxed});\n`;
+                        }
+                        if (this.packedArrayKind(call.returnType) === kind) {
+                            // the any[] implementation returns the boxed copy for this and any[]s for new arrays
+                            code += `(void*)${result} == (void*)${boxed} ? ${receiver} : cast_any_array_to_${kind}_array((array*)${result});`;
+                        } else if (!call.realVoid) {
+                            code += result + ';';
+                        }
+                        return `({\n${this.indent(code.trimEnd())}\n})`;
+                    } else if (call.cName || func.startsWith('js_global')) {
+                        return '((' + this.signature(call, '(*)', false) + ')' + callee + ')(' + argsArray.join(', ') + ')';
+                    } else {
+                        let temp = 'callee_' + Generator.nextTemp++;
+                        return `({closure* ${temp} = ${callee}; ((${this.signature(call, '(*)', true)})${temp}->func)(${[temp + '->env', ...argsArray].join(', ')});})`;
+                    }
                 } else {
                     let proto = node.callee.type === 'Identifier' ? 'js_variable_' + this.id + '_' + node.callee.name : this.expression(node.callee);
-                    return 'new(' + func + ', get(' + proto + ', "prototype"), ' + args + ')';
+                    return 'new(' + func + ', get_object_atom(' + proto + ', ' + this.atom('prototype') + ').object, ' + args + ')';
                 }
             case 'SequenceExpression':
                 return node.expressions.map(x => this.expression(x)).join(', ');
@@ -716,8 +2311,20 @@ export class Generator extends ASTManipulator {
             case 'ModuleExpression':
                 this.error('SyntaxError', 'Module expressions are not supported');
             case 'TemplateLiteral':
+                return this.concat(this.stringParts(node));
             case 'TaggedTemplateExpression':
-                this.error('SyntaxError', 'Template literals are not supported');
+                this.error('SyntaxError', 'Tagged template literals are not supported');
+            case 'TSAsExpression':
+            case 'TSTypeAssertion':
+                if (node.expression.type === 'CallExpression' && this.jsonMethod(node.expression) === 'parse') {
+                    return this.jsonParse(node.expression, this.infer.expression(node));
+                }
+                let fromType = this.simplify(this.infer.expression(node.expression));
+                let asType = this.simplify(this.infer.expression(node));
+                let value = this.expression(node.expression);
+                return this.type(fromType) === this.type(asType) ? value : this.to(asType, value, fromType);
+            case 'TSSatisfiesExpression':
+                return this.expression(node.expression);
             default:
                 this.error('InternalError', `Bad/unrecongnized AST node in Generator.statement() of type ${node.type}`);
         }
@@ -732,10 +2339,18 @@ export class Generator extends ASTManipulator {
         let out: string;
         switch (node.type) {
             case 'ExpressionStatement':
+                if (this.isRopeAppend(node.expression)) {
+                    // the result is unused, so don't flatten it
+                    return this.ropeAppend(node.expression) + ';\n';
+                }
                 return this.expression(node.expression) + ';\n';
             case 'BlockStatement':
                 this.pushScope();
                 node.body.forEach(x => this.infer.statement(x));
+                this.findRopes(node.body);
+                if (!this.isGlobal) {
+                    this.findStackAllocated(node.body);
+                }
                 out = '{\n' + this.indent((this.getDeclarations() + node.body.map(x => this.statement(x))).slice(0, -1)) + '\n}\n';
                 this.popScope();
                 return out;
@@ -792,13 +2407,14 @@ export class Generator extends ASTManipulator {
             case 'ForStatement':
                 this.pushScope();
                 out = 'for (';
+                let counter = this.integerLoop(node);
                 if (node.init) {
                     if (node.init.type === 'VariableDeclaration') {
                         out += this.statement(node.init).slice(0, -1) + ' ';
                         for (let decl of node.init.declarations) {
                             if (decl.id.type === 'Identifier') {
                                 let type = decl.init ? this.infer.expression(decl.init) : this.infer.type(decl.id.typeAnnotation);
-                                out = this.type(type) + ' ' + this.identifier(decl.id.name) + ';\n' + out;
+                                out = (counter?.name === decl.id.name ? counter.cType : this.type(type)) + ' ' + this.identifier(decl.id.name) + ';\n' + out;
                                 this.setVar(decl.id.name, type);
                             }
                         }
@@ -808,11 +2424,31 @@ export class Generator extends ASTManipulator {
                 } else {
                     out += '; ';
                 }
-                out += node.test ? this.expression(node.test) + '; ' : '; ';
-                if (node.update) {
-                    out += this.expression(node.update);
+                if (counter) {
+                    let test = node.test as b.BinaryExpression;
+                    let update = node.update as b.UpdateExpression | b.AssignmentExpression;
+                    let name = this.identifier(counter.name);
+                    out += `${name} ${test.operator} (${counter.cType})(${this.expression(test.right as b.Expression)}); `;
+                    out += update.type === 'UpdateExpression' ? name + update.operator : `${name} ${update.operator} ${(update.right as b.NumericLiteral).value}`;
+                    this.infer.integerVars.set(counter.name, counter.range);
+                } else {
+                    out += node.test ? this.expression(node.test) + '; ' : '; ';
+                    if (node.update) {
+                        out += this.expression(node.update);
+                    }
+                }
+                let bounded = this.boundedIndex(node);
+                let hoisted = bounded !== null && !this.boundedIndexes.has(bounded);
+                if (hoisted) {
+                    this.boundedIndexes.add(bounded!);
                 }
                 out += ') ' + this.statement(node.body);
+                if (hoisted) {
+                    this.boundedIndexes.delete(bounded!);
+                }
+                if (counter) {
+                    this.infer.integerVars.delete(counter.name);
+                }
                 this.popScope();
                 return out;
             case 'ForInStatement':
@@ -827,8 +2463,8 @@ export class Generator extends ASTManipulator {
                     out += this.type(type, 'obj') + ' = ' + this.expression(node.right) + ';\n';
                 }
                 let init: string;
-                if ('isArray' in type) {
-                    out += 'for (int i = 0; i < obj-length; i++) {\n';
+                if (type.type === 'object' && type.specialName === 'array') {
+                    out += 'for (uint32_t i = 0; i < obj->length; i++) {\n';
                     init = 'obj->items[i]';
                 } else {
                     out += 'object* iterator = get(obj, Symbol_iterator);\nwhile (true) {\nobject* data = call(obj, "next")\nif (get(data, "done")) break;\n';
@@ -852,13 +2488,20 @@ export class Generator extends ASTManipulator {
                 out = '';
                 for (let decl of node.declarations) {
                     if (decl.init) {
-                        out += this.assignment(decl.id, this.expression(decl.init)) + ';\n';
+                        let declType = decl.id.type === 'Identifier' && decl.id.typeAnnotation ? this.infer.type(decl.id.typeAnnotation) : undefined;
+                        if (decl.id.type === 'Identifier' && this.scope.stackAllocated.has(decl.id.name)) {
+                            out += this.assignment(decl.id, this.stackAllocate(decl.init)) + ';\n';
+                        } else if (declType && decl.init.type === 'ArrayExpression' && this.packedArrayKind(declType)) {
+                            out += this.assignment(decl.id, this.packedArray(decl.init, declType)) + ';\n';
+                        } else {
+                            out += this.assignment(decl.id, this.expression(decl.init)) + ';\n';
+                        }
                     }
                 }
                 return out;
             case 'ImportDeclaration':
                 let [path, id, scope] = this.getImportData(node.source.value);
-                this.importIncludes.push(`#include "${path}.c"`);
+                this.importIncludes.push(`#include "${path}.h"`);
                 for (let spec of node.specifiers) {
                     if (spec.type === 'ImportNamespaceSpecifier') {
                         this.error('SyntaxError', 'Namespace imports are not supported');
@@ -874,6 +2517,10 @@ export class Generator extends ASTManipulator {
                         let type = export_[0];
                         let fv = type.type === 'object' && type.call ? 'function' : 'variable';
                         this.importIncludes.push(`#define ${name} js_${fv}_${id}_${export_[1]}`);
+                        if (fv === 'function') {
+                            this.importedFunctions.add(spec.local.name);
+                            this.importIncludes.push(`#define ${name}_closure js_function_${id}_${export_[1]}_closure`);
+                        }
                     }
                 }
                 return '';
@@ -891,10 +2538,35 @@ export class Generator extends ASTManipulator {
         }
     }
 
+    // a fresh cache record for a property read site, or null if the site can't have one
+    inlineCache(): string | null {
+        if (this.inStruct) {
+            return null;
+        }
+        let name = `ic_${this.id}_${this.inlineCaches.length}`;
+        this.inlineCaches.push(`static inline_cache ${name};`);
+        return name;
+    }
+
+    // what other modules see through this module's header, call after program
+    header(): string {
+        return this.getDeclarations(true) + `void main_${this.id}();\n`;
+    }
+
     program(node: b.Program): string {
         this.importIncludes = [];
         this.functions = [];
+        this.profileSites = [];
+        this.inlineCaches = [];
+        this.closureDecls = [];
+        this.jsonFunctions = new Map();
+        this.builtinClosures = new Map();
+        this.moduleFunctions = new Set(functionDeclarations(node).map(func => func.id!.name));
+        this.importedFunctions = new Set();
+        this.moduleConstants = constantNames(node);
         this.infer.program(node);
+        this.findRopes(node.body);
+        this.checkLoopCaptures(node);
         for (let statement of node.body) {
             let code = this.statement(statement);
             if (code !== '') {
@@ -909,6 +2581,15 @@ export class Generator extends ASTManipulator {
         if (decls.length > 0) {
             out += decls + '\n\n';
         }
+        if (this.profileSites.length > 0) {
+            out += this.profileSites.join('\n') + '\n\n';
+        }
+        if (this.inlineCaches.length > 0) {
+            out += this.inlineCaches.join('\n') + '\n\n';
+        }
+        if (this.closureDecls.length > 0) {
+            out += this.closureDecls.join('\n') + '\n\n';
+        }
         if (this.functions.length > 0) {
             out += this.functions.join('\n\n') + '\n\n';
         }
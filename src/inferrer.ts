@@ -5,10 +5,19 @@ import {t, Type, Stack, Scope, ASTManipulator} from './util.js';
 import type {Compiler} from './compiler.js';
 
 
+// the smallest and largest integer a number expression can be
+export type IntegerRange = [number, number];
+
+const INT32_RANGE: IntegerRange = [-(2 ** 31), 2 ** 31 - 1];
+const UINT32_RANGE: IntegerRange = [0, 2 ** 32 - 1];
+
+
 export class Inferrer extends ASTManipulator {
 
     thisTypes: Stack<Type>;
     superTypes: Stack<Type>;
+    // the loop counters the generator has made C integers, see Generator.integerLoop
+    integerVars: Map<string, IntegerRange> = new Map();
 
     constructor(compiler: Compiler, fullPath: string, raw: string, scope?: Scope, useGlobalThis: boolean = true) {
         super(compiler, fullPath, raw, scope);
@@ -147,6 +156,7 @@ export class Inferrer extends ASTManipulator {
                 }
             }
         }
+        out.closed = !this.fullPath.endsWith('.d.ts');
         return out;
     }
 
@@ -524,6 +534,63 @@ export class Inferrer extends ASTManipulator {
         return t.number;
     }
 
+    /*
+    the range of a number expression that is always an integer (never -0, NaN or fractional), or null
+    these are integer literals, integer loop counters, lengths, the results of the bitwise operators, and sums, differences and products of those that stay exact in a double
+    */
+    integerRange(node: b.Expression | b.PrivateName): IntegerRange | null {
+        let out: IntegerRange | null = null;
+        switch (node.type) {
+            case 'NumericLiteral':
+                out = Number.isInteger(node.value) ? [node.value, node.value] : null;
+                break;
+            case 'Identifier':
+                out = this.integerVars.get(node.name) ?? null;
+                break;
+            case 'ParenthesizedExpression':
+                return this.integerRange(node.expression);
+            case 'MemberExpression':
+                if (!node.computed && node.property.type === 'Identifier' && node.property.name === 'length') {
+                    let type = this.expression(node.object);
+                    if (type.type === 'string' || type.type === 'string_value' || (type.type === 'object' && type.specialName && type.specialName.endsWith('array'))) {
+                        out = UINT32_RANGE;
+                    }
+                }
+                break;
+            case 'UnaryExpression':
+                if (node.operator === '~') {
+                    out = INT32_RANGE;
+                } else if (node.operator === '-') {
+                    // -0 isn't an integer here
+                    let arg = this.integerRange(node.argument);
+                    out = arg && arg[0] > 0 ? [-arg[1], -arg[0]] : null;
+                }
+                break;
+            case 'BinaryExpression':
+                if (node.operator === '&' || node.operator === '|' || node.operator === '^' || node.operator === '<<' || node.operator === '>>') {
+                    out = INT32_RANGE;
+                    break;
+                } else if (node.operator === '>>>') {
+                    out = UINT32_RANGE;
+                    break;
+                }
+                let left = this.integerRange(node.left);
+                let right = this.integerRange(node.right);
+                if (!left || !right) {
+                    return null;
+                } else if (node.operator === '+') {
+                    out = [left[0] + right[0], left[1] + right[1]];
+                } else if (node.operator === '-') {
+                    out = [left[0] - right[1], left[1] - right[0]];
+                } else if (node.operator === '*' && left[0] >= 0 && right[0] >= 0) {
+                    // a negative factor could make -0
+                    out = [left[0] * right[0], left[1] * right[1]];
+                }
+                break;
+        }
+        return out && Number.isSafeInteger(out[0]) && Number.isSafeInteger(out[1]) ? out : null;
+    }
+
     expression(node: b.Expression | b.PrivateName | b.V8IntrinsicIdentifier | b.ImportExpression | b.FunctionDeclaration | b.ClassDeclaration | b.TSDeclareFunction): Type {
         this.setSourceData(node);
         let out: Type;
@@ -600,9 +667,18 @@ export class Inferrer extends ASTManipulator {
                         }
                     }
                 }
+                // like tsc, a literal of only numbers, strings or booleans is widened to an array of them, which is stored packed
+                if (elts instanceof Array && elts.length > 0) {
+                    for (let base of ['number', 'string', 'boolean'] as const) {
+                        if (elts.every(elt => elt.type === base || elt.type === base + '_value')) {
+                            return t.array(t[base]);
+                        }
+                    }
+                }
                 return t.array(elts);
             case 'ObjectExpression':
                 out = t.object();
+                let closed = true;
                 for (let prop of node.properties) {
                     if (prop.type === 'SpreadElement') {
                         let type = this.expression(prop.argument);
@@ -615,14 +691,21 @@ export class Inferrer extends ASTManipulator {
                     if (prop.key.type === 'PrivateName') {
                         continue;
                     }
+                    if (prop.computed) {
+                        closed = false;
+                    }
                     let value: Type;
                     if (prop.type === 'ObjectProperty') {
                         value = this.expression(prop.value as b.Expression);
                     } else {
                         value = this.function(prop.params, prop.typeParameters, prop.returnType);
+                        closed = false;
                     }
                     this.setProp(out, this.property(prop.key), value);
                 }
+                if (out.type === 'object') {
+                    out.closed = closed && out.indexes.length === 0;
+                }
                 return out;
             case 'RecordExpression':
                 this.error('SyntaxError', 'Records are not supported');
@@ -727,6 +810,12 @@ export class Inferrer extends ASTManipulator {
                 }
             case 'CallExpression':
             case 'OptionalCallExpression':
+                let jsonMethod = this.jsonMethod(node);
+                if (jsonMethod === 'parse') {
+                    return t.any;
+                } else if (jsonMethod === 'stringify') {
+                    return t.string;
+                }
                 let func = this.expression(node.callee);
                 if (node.optional && (func.type === 'undefined' || func.type === 'null')) {
                     return func;
@@ -763,6 +852,12 @@ export class Inferrer extends ASTManipulator {
             case 'ImportExpression':
                 // return getImportType(this.fullPath, this.expression(node.source), node.options ? this.expression(node.options) : undefined);
                 return t.any;
+            case 'TSAsExpression':
+            case 'TSTypeAssertion':
+                this.expression(node.expression);
+                return this.type(node.typeAnnotation);
+            case 'TSSatisfiesExpression':
+                return this.expression(node.expression);
             case 'TSNonNullExpression':
                 out = this.expression(node.expression);
                 if (t.isNullish(out) === true) {
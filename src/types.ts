@@ -75,6 +75,7 @@ interface ObjectType extends BaseType<'object'> {
     call?: CallData;
     construct?: CallData;
     specialName?: SpecialName;
+    closed?: boolean;
 }
 
 export interface Union<T extends NonUnionType = NonUnionType> extends BaseType<'union'> {
@@ -273,7 +274,9 @@ const _object: TypeFactory<ObjectType, [props?: {[key: PropertyKey]: Type}, inde
     for (let index of this.indexes) {
         indexes.push({name: index.name, key: index.key.copy(), value: index.value.copy()});
     }
-    return object(props, indexes, call);
+    let out = object(props, indexes, call);
+    out.closed = this.closed;
+    return out;
 }, function(this: ObjectType, vars: {[key: string]: Type}) {
     let out = object();
     for (let key of Reflect.ownKeys(this.props)) {
@@ -293,6 +296,7 @@ const _object: TypeFactory<ObjectType, [props?: {[key: PropertyKey]: Type}, inde
             value: index.value.with(vars),
         })
     }
+    out.closed = this.closed;
     return out;
 });
 export const object: typeof _object & ObjectType = Object.assign(_object, _object());
@@ -39,11 +39,13 @@ const SHORT_NAMES: {[K in UnionType]: string} = {
 export interface UnionFuncCall {
     func: UnionFunc;
     args: (UnionType | Set<UnionType>)[];
+    // from a type profile, the member of each union argument that is tested first
+    hot?: (UnionType | null)[];
 }
 
 
 export function unionFuncCallsAreEqual(a: UnionFuncCall, b: UnionFuncCall): boolean {
-    if (a.func !== b.func || a.args.length !== b.args.length) {
+    if (a.func !== b.func || a.args.length !== b.args.length || String(a.hot ?? '') !== String(b.hot ?? '')) {
         return false;
     }
     for (let i = 0; i < a.args.length; i++) {
@@ -78,9 +80,334 @@ export function unionFuncCallsAreEqual(a: UnionFuncCall, b: UnionFuncCall): bool
 }
 
 export function getCUnionFuncName(call: UnionFuncCall): string {
-    return call.func + '_' + call.args.map(arg => arg instanceof Set ? Array.from(arg).map(x => SHORT_NAMES[x]).join('') : SHORT_NAMES[arg]).join('_');
+    let out = call.func + '_' + call.args.map(arg => arg instanceof Set ? Array.from(arg).map(x => SHORT_NAMES[x]).sort().join('') : SHORT_NAMES[arg]).join('_');
+    if (call.hot) {
+        out += '_hot_' + call.hot.map(type => type ? SHORT_NAMES[type] : 'x').join('');
+    }
+    return out;
+}
+
+
+// in the order of enum unknown_tag, starting at UNDEFINED_TAG
+export const TAGGED_TYPES: UnionType[] = ['undefined', 'null', 'boolean', 'number', 'string', 'symbol', 'bigint', 'object', 'function', 'proxy', 'array'];
+
+const TAGS: {[K in UnionType]?: string} = {
+    undefined: 'UNDEFINED_TAG',
+    null: 'NULL_TAG',
+    boolean: 'BOOLEAN_TAG',
+    number: 'NUMBER_TAG',
+    string: 'STRING_TAG',
+    symbol: 'SYMBOL_TAG',
+    bigint: 'BIGINT_TAG',
+    object: 'OBJECT_TAG',
+    function: 'FUNCTION_TAG',
+    proxy: 'PROXY_TAG',
+    array: 'ARRAY_TAG',
+};
+
+const C_TYPES: {[K in UnionType]?: string} = {
+    undefined: 'void*',
+    null: 'void*',
+    boolean: 'bool',
+    number: 'double',
+    string: 'char*',
+    symbol: 'symbol',
+    bigint: 'bigint*',
+    object: 'object*',
+    function: 'closure*',
+};
+
+const PRIMITIVES: UnionType[] = ['undefined', 'null', 'boolean', 'number', 'string', 'symbol', 'bigint'];
+
+type Result = UnionType | 'unknown';
+
+function getTag(type: UnionType): string {
+    return TAGS[type] ?? 'OBJECT_TAG';
+}
+
+function getCType(type: UnionType): string {
+    return C_TYPES[type] ?? type + '*';
+}
+
+function isNullish(type: UnionType): boolean {
+    return type === 'undefined' || type === 'null';
+}
+
+// members of a union without their own tag (typed arrays, maps, etc.) are all dispatched on as plain objects
+export function getDispatchType(type: UnionType): UnionType {
+    return type in TAGS ? type : 'object';
+}
+
+function getMember(type: UnionType, value: string): string {
+    switch (type) {
+        case 'undefined':
+        case 'null':
+            return 'NULL';
+        case 'number':
+            return `union_to_number(${value})`;
+        case 'boolean':
+        case 'string':
+        case 'symbol':
+        case 'bigint':
+        case 'object':
+        case 'function':
+        case 'proxy':
+        case 'array':
+            return `union_to_any(${value}).${type}`;
+        default:
+            return `((${getCType(type)})union_to_any(${value}).object)`;
+    }
+}
+
+function toUnknown(type: UnionType, value: string): string {
+    if (type in TAGS) {
+        return `create_unknown_from_${type}(${value})`;
+    } else {
+        return `create_unknown_from_object((object*)${value})`;
+    }
+}
+
+// an unknown for a runtime function that doesn't keep it, so it doesn't need a heap allocation
+function toTempUnknown(type: UnionType, value: string): string {
+    if (type in TAGS) {
+        return `union_to_temp_unknown(create_union_from_${type}(${value}))`;
+    } else {
+        return `union_to_temp_unknown(create_union_from_object((object*)${value}))`;
+    }
+}
+
+function literal(value: string): string {
+    return `STRING_LITERAL("${value}")`;
+}
+
+function toBoolean(type: UnionType, value: string): string {
+    switch (type) {
+        case 'undefined':
+        case 'null':
+            return 'false';
+        case 'boolean':
+            return value;
+        case 'number':
+            return `(${value} != 0 && ${value} == ${value})`;
+        case 'string':
+            return `(string_length(${value}) != 0)`;
+        case 'bigint':
+            return `(${value}->length != 0)`;
+        default:
+            return 'true';
+    }
+}
+
+function toNumber(type: UnionType, value: string): string {
+    switch (type) {
+        case 'undefined':
+        case 'symbol':
+            return 'NaN';
+        case 'null':
+            return '0.0';
+        case 'boolean':
+            return `((double)${value})`;
+        case 'number':
+            return value;
+        case 'string':
+            return `parse_number(${value})`;
+        case 'bigint':
+            return `bigint_to_number(${value})`;
+        case 'array':
+            return `parse_number(array_to_string(${value}))`;
+        default:
+            return `any_to_number(object_to_primitive((object*)${value}))`;
+    }
+}
+
+function toString(type: UnionType, value: string): string {
+    switch (type) {
+        case 'undefined':
+        case 'null':
+            return literal(type);
+        case 'boolean':
+            return `(${value} ? ${literal('true')} : ${literal('false')})`;
+        case 'number':
+            return `number_to_string(${value}, 10)`;
+        case 'string':
+            return value;
+        case 'symbol':
+            return literal('Symbol()');
+        case 'bigint':
+            return `bigint_to_string(${value}, 10)`;
+        case 'array':
+            return `array_to_string(${value})`;
+        default:
+            return `to_string(object_to_primitive((object*)${value}))`;
+    }
+}
+
+function typeOf(type: UnionType): string {
+    if (PRIMITIVES.includes(type)) {
+        return literal(type === 'null' ? 'object' : type);
+    } else {
+        return literal(type === 'function' ? 'function' : 'object');
+    }
+}
+
+function eq(a: UnionType, x: string, b: UnionType, y: string): string {
+    if (isNullish(a) || isNullish(b)) {
+        return String(isNullish(a) && isNullish(b));
+    } else if (!PRIMITIVES.includes(a) && !PRIMITIVES.includes(b)) {
+        return `((void*)${x} == (void*)${y})`;
+    } else if (!PRIMITIVES.includes(a) || !PRIMITIVES.includes(b)) {
+        return `eq(${toTempUnknown(a, x)}, ${toTempUnknown(b, y)})`;
+    } else if (a === b) {
+        return seq(a, x, b, y);
+    } else if (a === 'symbol' || b === 'symbol') {
+        return 'false';
+    } else if (a === 'boolean') {
+        return eq('number', `((double)${x})`, b, y);
+    } else if (b === 'boolean') {
+        return eq(a, x, 'number', `((double)${y})`);
+    } else {
+        return `(${toNumber(a, x)} == ${toNumber(b, y)})`;
+    }
+}
+
+function seq(a: UnionType, x: string, b: UnionType, y: string): string {
+    if (a !== b) {
+        return 'false';
+    } else if (isNullish(a)) {
+        return 'true';
+    } else if (a === 'string') {
+        return `string_equals(${x}, ${y})`;
+    } else if (a === 'bigint') {
+        return `bigint_eq(${x}, ${y})`;
+    } else {
+        return `(${x} == ${y})`;
+    }
+}
+
+function add(a: UnionType, x: string, b: UnionType, y: string): [string, Result] {
+    if (!PRIMITIVES.includes(a) || !PRIMITIVES.includes(b)) {
+        return [`union_from_unknown(add(${toTempUnknown(a, x)}, ${toTempUnknown(b, y)}))`, 'unknown'];
+    } else if (a === 'string' || b === 'string') {
+        return [`stradd(${toString(a, x)}, ${toString(b, y)})`, 'string'];
+    } else if (a === 'bigint' && b === 'bigint') {
+        return [`bigint_add(${x}, ${y})`, 'bigint'];
+    } else {
+        return [`${toNumber(a, x)} + ${toNumber(b, y)}`, 'number'];
+    }
+}
+
+function getLeaf(call: UnionFuncCall, types: UnionType[], values: string[]): [string, Result] {
+    let [a, b] = types;
+    let [x, y] = values;
+    switch (call.func) {
+        case 'add':
+            return add(a, x, b, y);
+        case 'eq':
+            return [eq(a, x, b, y), 'boolean'];
+        case 'seq':
+            return [seq(a, x, b, y), 'boolean'];
+        case 'typeof':
+            return [typeOf(a), 'string'];
+        case 'to_boolean':
+            return [toBoolean(a, x), 'boolean'];
+        case 'to_number':
+            return [toNumber(a, x), 'number'];
+        case 'to_string':
+            return [toString(a, x), 'string'];
+        case 'to_primitive':
+            if (PRIMITIVES.includes(a)) {
+                return [isNullish(a) ? 'NULL' : x, a];
+            } else {
+                return [`union_from_unknown(object_to_primitive((object*)${x}))`, 'unknown'];
+            }
+        case 'to_any':
+            return [toUnknown(a, x), 'unknown'];
+    }
+}
+
+function getCombinations(call: UnionFuncCall, index: number = 0): UnionType[][] {
+    if (index === call.args.length) {
+        return [[]];
+    }
+    let arg = call.args[index];
+    let types = arg instanceof Set ? Array.from(arg) : [arg];
+    let rest = getCombinations(call, index + 1);
+    return types.flatMap(type => rest.map(types => [type, ...types]));
+}
+
+function dispatch(call: UnionFuncCall, names: string[], leaf: (types: UnionType[], values: string[]) => string, index: number = 0, types: UnionType[] = [], values: string[] = []): string {
+    if (index === call.args.length) {
+        return leaf(types, values);
+    }
+    let arg = call.args[index];
+    let name = names[index];
+    if (!(arg instanceof Set)) {
+        return dispatch(call, names, leaf, index + 1, [...types, arg], [...values, name]);
+    }
+    let possible = Array.from(arg);
+    let hot = call.hot?.[index];
+    let out = '';
+    if (hot && possible.length > 1 && possible.includes(hot)) {
+        // the profiled type gets a predicted branch of its own before the switch
+        out += `if (__builtin_expect(union_type(${name}) == ${getTag(hot)}, 1)) {\n`;
+        out += dispatch(call, names, leaf, index + 1, [...types, hot], [...values, getMember(hot, name)]).split('\n').map(line => '    ' + line).join('\n') + '\n}\n';
+        possible = possible.filter(type => type !== hot);
+    }
+    if (possible.length === 1) {
+        return out + dispatch(call, names, leaf, index + 1, [...types, possible[0]], [...values, getMember(possible[0], name)]);
+    }
+    out += `switch (union_type(${name})) {\n`;
+    for (let i = 0; i < possible.length; i++) {
+        let type = possible[i];
+        out += (i === possible.length - 1 ? '    default:\n' : `    case ${getTag(type)}:\n`);
+        out += dispatch(call, names, leaf, index + 1, [...types, type], [...values, getMember(type, name)]).split('\n').map(line => '        ' + line).join('\n') + '\n';
+    }
+    return out + '}';
+}
+
+function getResult(call: UnionFuncCall): Result {
+    let results = new Set(getCombinations(call).map(types => getLeaf(call, types, types.map(() => '')).at(1)));
+    return results.size === 1 ? Array.from(results)[0] as Result : 'unknown';
+}
+
+function getSignature(call: UnionFuncCall, name: string, nanBoxing: boolean): string {
+    let params = call.args.map((arg, i) => arg instanceof Set ? 'unknown arg_' + i : getCType(arg) + ' arg_' + i).join(', ');
+    let result = getResult(call);
+    let returnType: string;
+    if (call.func === 'to_any') {
+        returnType = nanBoxing ? 'unknown' : 'unknown*';
+    } else if (result === 'unknown') {
+        returnType = 'unknown';
+    } else {
+        returnType = getCType(result);
+    }
+    return `static inline ${returnType} ${name}(${params})`;
+}
+
+export function createUnionFunc(call: UnionFuncCall, nanBoxing: boolean = false): string {
+    let names = call.args.map((_, i) => 'arg_' + i);
+    let name = getCUnionFuncName(call);
+    if (call.func === 'to_any' && call.args[0] instanceof Set) {
+        return `${getSignature(call, name, nanBoxing)} {\n    return union_to_unknown(arg_0);\n}\n`;
+    }
+    let result = getResult(call);
+    let body = dispatch(call, names, (types, values) => {
+        let [value, type] = getLeaf(call, types, values);
+        if (result === 'unknown' && call.func !== 'to_any') {
+            value = type === 'unknown' ? value : `create_union_from_${type in TAGS ? type : 'object'}(${value})`;
+        }
+        return `return ${value};`;
+    });
+    return `${getSignature(call, name, nanBoxing)} {\n${body.split('\n').map(line => '    ' + line).join('\n')}\n}\n`;
 }
 
-export function createUnionFunc(call: UnionFuncCall): string {
-    
+// a call site of a union function in an instrumented build, it records the type of each union argument in site
+export function createProfiledUnionFunc(call: UnionFuncCall, name: string, site: string, nanBoxing: boolean = false): string {
+    let out = `${getSignature(call, name, nanBoxing)} {\n`;
+    call.args.forEach((arg, i) => {
+        if (arg instanceof Set) {
+            out += `    profile_union(&${site}, ${i}, arg_${i});\n`;
+        }
+    });
+    return out + `    return ${getCUnionFuncName(call)}(${call.args.map((_, i) => 'arg_' + i).join(', ')});\n}\n`;
 }
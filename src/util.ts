@@ -124,6 +124,10 @@ export class Scope {
     types: Map<string, Type> = new Map();
     exports: Map<string, [Type, string]> = new Map();
     imports: Set<string> = new Set();
+    // string variables the generator keeps as ropes, see Generator.findRopes
+    ropes: Set<string> = new Set();
+    // locals whose object or array literal never escapes, see Generator.findStackAllocated
+    stackAllocated: Set<string> = new Set();
     thisTypes: Stack<Type>;
     superTypes: Stack<Type>;
 
@@ -300,6 +304,19 @@ export class ASTManipulator {
         return this.scope.globalIsShadowed(name);
     }
 
+    // which method a call to the builtin JSON is, those are compiled to the runtime's parser and writer instead of looked up
+    jsonMethod(node: b.CallExpression | b.OptionalCallExpression): 'parse' | 'stringify' | null {
+        let callee = node.callee;
+        if (callee.type !== 'MemberExpression' || callee.computed || callee.object.type !== 'Identifier' || callee.object.name !== 'JSON' || callee.property.type !== 'Identifier') {
+            return null;
+        }
+        if (this.varExists('JSON') && (!this.globalVarExists('JSON') || this.globalIsShadowed('JSON'))) {
+            return null;
+        }
+        let name = callee.property.name;
+        return name === 'parse' || name === 'stringify' ? name : null;
+    }
+
     getRaw(node: b.Node): string {
         if (!node.loc) {
             throw new Error('Node.loc is missing');
@@ -375,6 +392,9 @@ export class ASTManipulator {
                 return t.any;
             case 'object':
                 if (typeof key !== 'object') {
+                    if (type.closed && !(key in type.props)) {
+                        type.closed = false;
+                    }
                     type.props[key] = value;
                 } else {
                     for (let index of type.indexes) {
@@ -384,7 +404,9 @@ export class ASTManipulator {
                         }
                     }
                     type.indexes.push({name: 'key', key, value});
+                    type.closed = false;
                 }
+                return type;
             default:
                 this.error('TypeError', `Cannot set properties of ${type.type} (setting ${String(key)})`);
         }